@@ -0,0 +1,161 @@
+-- generates the files the benchmark scenarios are run against. Every corpus
+-- is written once into `bench/corpus` and reused by later runs; the same size
+-- always gives the same contents. LITE_BENCH_SCALE scales every corpus down
+-- (or up) from its standard size, for quick runs
+local corpus = {}
+
+local bench_dir = debug.getinfo(1, "S").source:match("^@(.+)[/\\]")
+corpus.dir = bench_dir .. PATHSEP .. "corpus"
+corpus.scale = tonumber(os.getenv("LITE_BENCH_SCALE")) or 1
+
+-- the text searched for by the scenarios, found once at the end of each corpus
+corpus.needle = "BENCH_NEEDLE"
+
+
+local seed = 1
+
+local function random(n)
+  seed = (seed * 1103515245 + 12345) % 2147483648
+  return seed % n + 1
+end
+
+
+-- calls `fn(path)` to write the corpus if it doesn't exist yet, returns the
+-- corpus' path
+local function generate(name, fn)
+  local path = corpus.dir .. PATHSEP .. name
+  if not system.get_file_info(path) then
+    system.mkdir(corpus.dir)
+    seed = 1
+    fn(path .. ".tmp")
+    assert(os.rename(path .. ".tmp", path))
+  end
+  return path
+end
+
+
+local function write_lines(path, count, line_fn)
+  local fp = assert(io.open(path, "wb"))
+  local t = {}
+  for i = 1, count do
+    t[#t + 1] = line_fn(i)
+    if #t == 1000 then
+      fp:write(table.concat(t, "\n"), "\n")
+      t = {}
+    end
+  end
+  t[#t + 1] = corpus.needle
+  fp:write(table.concat(t, "\n"), "\n")
+  fp:close()
+end
+
+
+local c_lines = {
+  "/* %d: the quick brown fox jumps over the lazy dog */",
+  "static int function_%d(int a, const char *s) {",
+  "  int result = a * %d + strlen(s); // multiply and add",
+  "  if (result > 0x%x && s[0] != '\\0') { return -1; }",
+  "  printf(\"value %%d of %d\\n\", result);",
+  "#define MACRO_%d(x) ((x) << 2)",
+  "  return result;",
+  "}",
+  "",
+}
+
+function corpus.c_file(lines)
+  lines = math.floor(lines * corpus.scale)
+  return generate(string.format("lines_%d.c", lines), function(path)
+    write_lines(path, lines, function(i)
+      return string.format(c_lines[(i - 1) % #c_lines + 1], i)
+    end)
+  end)
+end
+
+
+function corpus.minified_json(bytes)
+  bytes = math.floor(bytes * corpus.scale)
+  return generate(string.format("minified_%d.json", bytes), function(path)
+    local fp = assert(io.open(path, "wb"))
+    local size, i = 1, 0
+    fp:write("[")
+    while size < bytes do
+      i = i + 1
+      local item = string.format(
+        '{"id":%d,"name":"item %d","tags":["t%d","t%d"],"value":%d.%d,' ..
+        '"active":%s,"parent":null},',
+        i, i, random(100), random(100), random(10000), random(100),
+        random(2) == 1 and "true" or "false")
+      fp:write(item)
+      size = size + #item
+    end
+    fp:write('"', corpus.needle, '"]')
+    fp:close()
+  end)
+end
+
+
+-- a tree of `files` files spread evenly over three levels of directories
+function corpus.tree(files)
+  files = math.floor(files * corpus.scale)
+  return generate(string.format("tree_%d", files), function(path)
+    local per_dir = math.ceil(files / 1000)
+    local n = 0
+    local function make_dir(parent, i)
+      local dir = parent .. PATHSEP .. "dir_" .. i
+      system.mkdir(dir)
+      return dir
+    end
+    system.mkdir(path)
+    for i = 1, 10 do
+      local dir1 = make_dir(path, i)
+      for j = 1, 10 do
+        local dir2 = make_dir(dir1, j)
+        for k = 1, 10 do
+          local dir3 = make_dir(dir2, k)
+          for _ = 1, per_dir do
+            n = n + 1
+            if n > files then return end
+            local name = n == files and corpus.needle or "file_" .. n
+            local fp = assert(io.open(dir3 .. PATHSEP .. name .. ".c", "wb"))
+            fp:write(string.format("int value_%d = %d;\n", n, n))
+            fp:close()
+          end
+        end
+      end
+    end
+  end)
+end
+
+
+local function utf8_encode(c)
+  if c < 0x800 then
+    return string.char(0xc0 + math.floor(c / 0x40), 0x80 + c % 0x40)
+  end
+  return string.char(0xe0 + math.floor(c / 0x1000),
+    0x80 + math.floor(c / 0x40) % 0x40, 0x80 + c % 0x40)
+end
+
+-- lines of CJK ideographs and kana, with the odd bit of ASCII
+function corpus.cjk(lines)
+  lines = math.floor(lines * corpus.scale)
+  return generate(string.format("cjk_%d.txt", lines), function(path)
+    write_lines(path, lines, function(i)
+      local t = { tostring(i), ". " }
+      for _ = 1, 40 do
+        local r = random(10)
+        if r <= 6 then
+          t[#t + 1] = utf8_encode(0x4e00 + random(0x51a5))
+        elseif r <= 9 then
+          t[#t + 1] = utf8_encode(0x3040 + random(0x5f))
+        else
+          t[#t + 1] = "ab "
+        end
+      end
+      t[#t + 1] = utf8_encode(0x3002)
+      return table.concat(t)
+    end)
+  end)
+end
+
+
+return corpus
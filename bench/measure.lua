@@ -0,0 +1,112 @@
+local core = require "core"
+local common = require "core.common"
+local search = require "core.doc.search"
+local corpus = require "corpus"
+
+-- the measurements shared by the scenarios, each recorded as a session metric
+-- in seconds unless named otherwise
+local measure = {}
+
+
+local function percentile(sorted, p)
+  return sorted[math.max(1, math.ceil(#sorted * p))]
+end
+
+
+local function highlighting_done(doc)
+  local hl = doc.highlighter
+  return hl.first_invalid_line > hl.max_wanted_line
+end
+
+
+-- opens `filename` and measures loading it, drawing it, highlighting all of
+-- it, scrolling through it, typing into it and searching it for the corpus'
+-- needle. `opt.keystrokes` is how many characters are typed
+function measure.doc(s, filename, opt)
+  opt = opt or {}
+
+  s:section("load")
+  local start = system.get_time()
+  local doc = core.open_doc(filename)
+  s:metric("load", system.get_time() - start)
+  local view = core.root_view:open_doc(doc)
+  core.redraw = true
+  s:frame()
+  s:metric("first_paint", system.get_time() - start)
+
+  -- the highlighter tokenizes up to the last line drawn, so show the end
+  s:section("highlight")
+  start = system.get_time()
+  view:scroll_to_line(#doc.lines, false, true)
+  core.redraw = true
+  s:frame()
+  s:wait(function() return highlighting_done(doc) end, opt.timeout or 600)
+  s:metric("highlight", system.get_time() - start)
+
+  s:section("scroll")
+  view:scroll_to_line(1, false, true)
+  s:settle()
+  start = system.get_time()
+  local frames = 300
+  s:scroll(view, 3, frames)
+  s:metric("scroll_fps", frames / (system.get_time() - start))
+
+  -- the time from each key's text being input until the frame showing it
+  s:section("type")
+  doc:set_selection(math.min(20, #doc.lines), 1)
+  local latencies = {}
+  local text = "typed ab cd ef gh ij kl mn op"
+  for i = 1, opt.keystrokes or 100 do
+    local n = (i - 1) % #text + 1
+    start = system.get_time()
+    core.on_event("textinput", text:sub(n, n))
+    core.redraw = true
+    s:frame()
+    latencies[i] = system.get_time() - start
+  end
+  table.sort(latencies)
+  s:metric("keystroke_p50", percentile(latencies, 0.5))
+  s:metric("keystroke_p99", percentile(latencies, 0.99))
+  s:metric("keystroke_max", latencies[#latencies])
+
+  s:section("search")
+  start = system.get_time()
+  local line = search.find(doc, 1, 1, corpus.needle, { no_case = true })
+  s:metric("search", system.get_time() - start)
+  assert(line, "needle not found")
+end
+
+
+-- scans the tree at `path` the way the project is scanned, then measures
+-- finding a file in it by fuzzy matching, as done by core:find-file
+function measure.tree(s, path)
+  s:section("scan")
+  local start = system.get_time()
+  local scan = assert(system.scan_tree(path, {}))
+  local files = {}
+  while true do
+    local chunk = scan:read(5000)
+    if not chunk then break end
+    for _, info in ipairs(chunk) do
+      if info.type == "file" then table.insert(files, info.filename) end
+    end
+    s:frame()
+  end
+  s:metric("scan", system.get_time() - start)
+  s:metric("files", #files)
+
+  s:section("find")
+  start = system.get_time()
+  local match = common.fuzzy_matcher(files)
+  s:metric("matcher", system.get_time() - start)
+  start = system.get_time()
+  local query = corpus.needle:lower()
+  for i = 1, #query do
+    match(query:sub(1, i), 100)
+  end
+  s:metric("find", (system.get_time() - start) / #query)
+  assert(match(query, 1)[1]:find(corpus.needle, 1, true), "needle not found")
+end
+
+
+return measure
@@ -0,0 +1,5 @@
+-- a C source file of a million lines
+local corpus = require "corpus"
+local measure = require "measure"
+
+measure.doc(..., corpus.c_file(1000000))
@@ -0,0 +1,5 @@
+-- a document of mostly CJK ideographs and kana
+local corpus = require "corpus"
+local measure = require "measure"
+
+measure.doc(..., corpus.cjk(100000))
@@ -0,0 +1,5 @@
+-- 50MB of minified JSON on a single line
+local corpus = require "corpus"
+local measure = require "measure"
+
+measure.doc(..., corpus.minified_json(50 * 1024 * 1024), { keystrokes = 3 })
@@ -0,0 +1,5 @@
+-- a project tree of a hundred thousand files
+local corpus = require "corpus"
+local measure = require "measure"
+
+measure.tree(..., corpus.tree(100000))
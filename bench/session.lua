@@ -0,0 +1,38 @@
+-- opens a large generated C file, scrolls through it, types into it and
+-- searches it; run with:
+--
+--   LITE_HEADLESS=1280x800 LITE_BENCH=bench/session.lua ./lite
+--
+local s = ...
+
+local dir = debug.getinfo(1, "S").source:match("^@(.+)[/\\]") or "."
+local filename = dir .. PATHSEP .. "session.c"
+if not system.get_file_info(filename) then
+  local fp = assert(io.open(filename, "wb"))
+  for i = 1, 100000 do
+    fp:write(string.format(
+      "static int function_%d(int a, int b) { return a * %d + b; /* %d */ }\n",
+      i, i % 97, i))
+  end
+  fp:close()
+end
+
+s:section("open")
+local view = s:open(filename)
+s:check_frame("open")
+
+s:section("scroll")
+s:scroll(view, 3, 300)
+s:scroll(view, 200, 100)
+s:check_frame("scroll")
+
+s:section("type")
+view.doc:set_selection(view:get_visible_line_range() + 10, 1)
+s:type("int typed_in_the_benchmark = 123;\n")
+s:check_frame("type")
+
+s:section("search")
+s:command("find-replace:find")
+s:type("function_25000", 14)
+s:key("return")
+s:check_frame("search")
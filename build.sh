@@ -40,4 +40,34 @@ fi
 echo "cleaning up..."
 rm *.o
 rm res.res 2>/dev/null
+
+# precompiles the lua modules into data/bundle.luac, which is used in place of
+# their sources for as long as those are unchanged
+if [[ $* == *bundle* && ! $got_error && $platform == "unix" ]]; then
+  echo "bundling..."
+  LITE_HEADLESS=1x1 LITE_BUILD_BUNDLE=1 ./$outfile
+fi
+
+# runs each scenario headless, collecting their reports in bench/results.json
+if [[ $* == *bench* && ! $got_error && $platform == "unix" ]]; then
+  echo "running benchmarks..."
+  results="$PWD/bench/results.json"
+  commit=`git describe --always --dirty 2>/dev/null`
+  echo "{\"commit\": \"$commit\", \"scenarios\": {" > $results
+  sep=""
+  for f in bench/scenarios/*.lua; do
+    name=`basename $f .lua`
+    echo "  $name"
+    report=`LUA_PATH="$PWD/bench/?.lua;;" LITE_HEADLESS=1280x800 \
+      LITE_BENCH="$PWD/$f" ./$outfile bench/scenarios | tail -n 1`
+    if [[ $report != "{"* ]]; then
+      report="{\"error\": \"no report\"}"
+    fi
+    echo "$sep\"$name\": $report" >> $results
+    sep=","
+  done
+  echo "}}" >> $results
+  echo "results written to bench/results.json"
+fi
+
 echo "done"
@@ -0,0 +1,223 @@
+local core = require "core"
+local common = require "core.common"
+local command = require "core.command"
+local profiler = require "core.profiler"
+
+-- replays a scripted session and reports how long its frames took. The script
+-- is a Lua file run in a thread with a session as its argument, whose methods
+-- act as the user would and each take at least a frame:
+--
+--   local s = ...
+--   s:section("open")
+--   local view = s:open("big.c")
+--   s:section("scroll")
+--   s:scroll(view, 40, 200)
+--   s:check_frame("scrolled")
+--
+-- Frames are grouped by the last `section()`, each reporting percentiles of
+-- its frame times in milliseconds. `check_frame()` compares the framebuffer
+-- pixel for pixel against `golden/<name>.ppm` next to the script, writing it
+-- if it doesn't exist or LITE_BENCH_UPDATE is set. The report is printed as
+-- JSON, along with the session's metrics and the peak memory use, and the
+-- editor exits with 1 if any frame differed from its golden image
+local bench = {}
+
+local modkeys = { ctrl = "left ctrl", shift = "left shift", alt = "left alt" }
+
+local Session = {}
+Session.__index = Session
+
+
+function Session:frame(n)
+  for _ = 1, n or 1 do
+    coroutine.yield(0)
+    local f = profiler.last_frame()
+    table.insert(self.current.frames, f.total)
+  end
+end
+
+
+function Session:section(name)
+  local time = system.get_time()
+  if self.current then self.current.finish = time end
+  self.current = { name = name, frames = {}, start = time }
+  table.insert(self.sections, self.current)
+end
+
+
+-- records a named measurement, such as a time in seconds, for the report
+function Session:metric(name, value)
+  table.insert(self.metrics, { name = name, value = value })
+end
+
+
+function Session:wait(fn, timeout)
+  local limit = system.get_time() + (timeout or 10)
+  while not fn() do
+    if system.get_time() > limit then
+      error("timed out waiting in " .. self.current.name, 2)
+    end
+    self:frame()
+  end
+end
+
+
+-- waits until every doc's highlighting has caught up and a frame is drawn
+-- without changing anything on screen. The caret's blink is held so it is
+-- always drawn the same way
+function Session:settle()
+  core.redraw = true
+  self:wait(function()
+    if core.active_view.blink_start then
+      core.active_view.blink_start = system.get_time()
+    end
+    for _, doc in ipairs(core.docs) do
+      local hl = doc.highlighter
+      if hl.first_invalid_line <= hl.max_wanted_line then return false end
+    end
+    return profiler.last_frame().rects == 0
+  end, 60)
+end
+
+
+function Session:open(filename)
+  local view = core.root_view:open_doc(core.open_doc(filename))
+  core.redraw = true
+  self:frame()
+  return view
+end
+
+
+function Session:command(name, ...)
+  command.perform(name, ...)
+  core.redraw = true
+  self:frame()
+end
+
+
+function Session:type(text, per_frame)
+  per_frame = per_frame or 1
+  local n = 0
+  for char in common.utf8_chars(text) do
+    core.on_event("textinput", char)
+    core.redraw = true
+    n = n + 1
+    if n % per_frame == 0 then self:frame() end
+  end
+  if n % per_frame ~= 0 then self:frame() end
+end
+
+
+-- presses and releases a key stroke such as "ctrl+f" or "return"
+function Session:key(stroke)
+  local keys = {}
+  for key in stroke:gmatch("[^+]+") do
+    table.insert(keys, modkeys[key] or key)
+  end
+  for _, key in ipairs(keys) do core.on_event("keypressed", key) end
+  for i = #keys, 1, -1 do core.on_event("keyreleased", keys[i]) end
+  core.redraw = true
+  self:frame()
+end
+
+
+-- scrolls `view` by `lines` lines each frame, for `frames` frames
+function Session:scroll(view, lines, frames)
+  for _ = 1, frames do
+    view.scroll.to.y = view.scroll.to.y + lines * view:get_line_height()
+    self:frame()
+  end
+end
+
+
+function Session:check_frame(name)
+  self:settle()
+  local filename = self.golden_dir .. PATHSEP .. name .. ".ppm"
+  local result = { name = name }
+  local diff = renderer.compare_frame(filename)
+  if os.getenv("LITE_BENCH_UPDATE") then
+    system.mkdir(self.golden_dir)
+    assert(renderer.save_frame(filename))
+    result.status = "written"
+  elseif not diff then
+    -- a missing golden fails the check rather than being taken as correct
+    result.status = "missing"
+    self.failed = true
+  elseif diff > 0 then
+    renderer.save_frame(self.golden_dir .. PATHSEP .. name .. ".actual.ppm")
+    result.status = "differs"
+    result.pixels = diff
+    self.failed = true
+  else
+    result.status = "matches"
+  end
+  table.insert(self.checks, result)
+end
+
+
+local function percentile(sorted, p)
+  return sorted[math.max(1, math.ceil(#sorted * p))]
+end
+
+
+function Session:report(err)
+  local sections = {}
+  for _, s in ipairs(self.sections) do
+    local sorted, sum = {}, 0
+    for i, t in ipairs(s.frames) do
+      sorted[i] = t * 1000
+      sum = sum + sorted[i]
+    end
+    table.sort(sorted)
+    if #sorted > 0 then
+      table.insert(sections, string.format(
+        '{"name": "%s", "frames": %d, "total": %.3f, "mean": %.3f, ' ..
+        '"p50": %.3f, "p90": %.3f, "p99": %.3f, "max": %.3f}',
+        s.name, #sorted, (s.finish - s.start) * 1000, sum / #sorted,
+        percentile(sorted, 0.5), percentile(sorted, 0.9),
+        percentile(sorted, 0.99), sorted[#sorted]))
+    end
+  end
+  local checks = {}
+  for _, c in ipairs(self.checks) do
+    table.insert(checks, string.format('{"name": "%s", "status": "%s"%s}',
+      c.name, c.status, c.pixels and (', "pixels": ' .. c.pixels) or ""))
+  end
+  local metrics = {}
+  for _, m in ipairs(self.metrics) do
+    local fmt = m.value % 1 == 0 and '"%s": %d' or '"%s": %.6g'
+    table.insert(metrics, string.format(fmt, m.name, m.value))
+  end
+  return string.format(
+    '{"version": "%s", "sections": [%s], "metrics": {%s}, "checks": [%s]%s}',
+    VERSION, table.concat(sections, ", "), table.concat(metrics, ", "),
+    table.concat(checks, ", "), err and ', "error": ' .. profiler.json_string(err) or "")
+end
+
+
+function bench.run(filename)
+  local fn = assert(loadfile(filename))
+  local session = setmetatable({
+    sections = {}, metrics = {}, checks = {}, failed = false,
+    golden_dir = (filename:match("^(.+)[/\\]") or ".") .. PATHSEP .. "golden",
+  }, Session)
+  session:section("session")
+
+  core.add_thread(function()
+    -- let the first frame be drawn before starting
+    coroutine.yield(0)
+    local ok, err = xpcall(fn, debug.traceback, session)
+    session.current.finish = system.get_time()
+    local peak = system.get_peak_memory()
+    if peak then session:metric("peak_memory", peak) end
+    print(session:report(not ok and err:match("[^\n]*") or nil))
+    if not ok then
+      io.stderr:write(err, "\n")
+      os.exit(2)
+    end
+    os.exit(session.failed and 1 or 0)
+  end, nil, "interactive")
+end
+
+
+return bench
@@ -0,0 +1,117 @@
+-- precompiled bytecode for the modules in data/core, data/plugins and
+-- data/user, kept in a single archive written by `build.sh bundle`. Each
+-- module is stored with the size and modification time of its source, and is
+-- only loaded from the archive while its source is unchanged; any other
+-- module is loaded from source as usual
+local bundle = {}
+
+local magic = "LITEBUNDLE " .. _VERSION .. "\n"
+local dirs = { "core", "plugins", "user" }
+
+bundle.filename = EXEDIR .. "/data/bundle.luac"
+
+local data_dir = EXEDIR .. "/data"
+local archive
+local entries = {}
+
+
+local function searcher(name)
+  local entry = entries[name]
+  if not entry then
+    return "\n\tno module '" .. name .. "' in bundle"
+  end
+  local filename = data_dir .. "/" .. entry.path
+  local info = system.get_file_info(filename)
+  if not info or info.size ~= entry.size or info.modified ~= entry.modified then
+    return "\n\tbundled module '" .. name .. "' is out of date"
+  end
+  local code = archive:sub(entry.offset, entry.offset + entry.length - 1)
+  local fn, err = load(code, "@" .. filename, "b")
+  if not fn then
+    return "\n\t" .. err
+  end
+  return fn, filename
+end
+
+
+-- reads the archive and adds a searcher for its modules ahead of the one
+-- searching `package.path`, returns false if there is no usable archive
+function bundle.install(filename)
+  local fp = io.open(filename or bundle.filename, "rb")
+  if not fp then return false end
+  archive = fp:read("*a")
+  fp:close()
+  if archive:sub(1, #magic) ~= magic then return false end
+
+  -- each module is a line of `name path size modified length` followed by
+  -- `length` bytes of bytecode
+  local offset = #magic + 1
+  while offset <= #archive do
+    local eol = archive:find("\n", offset, true)
+    if not eol then return false end
+    local name, path, size, modified, length =
+      archive:sub(offset, eol - 1):match("^(%S+) (%S+) (%d+) (%d+) (%d+)$")
+    if not name then return false end
+    entries[name] = {
+      path = path,
+      size = tonumber(size),
+      modified = tonumber(modified),
+      offset = eol + 1,
+      length = tonumber(length),
+    }
+    offset = eol + 1 + tonumber(length)
+  end
+
+  table.insert(package.searchers, 2, searcher)
+  return true
+end
+
+
+local function list_modules(dir, modules)
+  local files = system.list_dir(data_dir .. "/" .. dir) or {}
+  table.sort(files)
+  for _, file in ipairs(files) do
+    local path = dir .. "/" .. file
+    local info = system.get_file_info(data_dir .. "/" .. path)
+    if info and info.type == "dir" then
+      list_modules(path, modules)
+    elseif info and file:find("%.lua$") then
+      local name = path:gsub("%.lua$", ""):gsub("/init$", ""):gsub("/", ".")
+      table.insert(modules, { name = name, path = path, info = info })
+    end
+  end
+  return modules
+end
+
+
+-- compiles every module into the archive at `filename`, leaving out any that
+-- fail to compile so they still report their errors when required. Returns
+-- the number of modules written, or nil and an error
+function bundle.build(filename)
+  filename = filename or bundle.filename
+  local t = { magic }
+  local count = 0
+  for _, dir in ipairs(dirs) do
+    for _, mod in ipairs(list_modules(dir, {})) do
+      local fn, err = loadfile(data_dir .. "/" .. mod.path)
+      if fn then
+        local code = string.dump(fn)
+        table.insert(t, string.format("%s %s %d %d %d\n", mod.name, mod.path,
+          mod.info.size, mod.info.modified, #code))
+        table.insert(t, code)
+        count = count + 1
+      else
+        print("skipped " .. err)
+      end
+    end
+  end
+
+  local fp, err = io.open(filename, "wb")
+  if not fp then return nil, err end
+  fp:write(table.concat(t))
+  fp:close()
+  return count
+end
+
+
+return bundle
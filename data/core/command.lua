@@ -38,11 +38,20 @@ function command.get_all_valid()
       table.insert(res, name)
     end
   end
+  -- commands of plugins not loaded yet, which load them when performed
+  for _, plugin in ipairs(core.lazy_plugins) do
+    for _, name in ipairs(plugin.commands or {}) do
+      table.insert(res, name)
+    end
+  end
   return res
 end
 
 
 local function perform(name)
+  if not command.map[name] then
+    core.trigger_plugins("commands", name)
+  end
   local cmd = command.map[name]
   if cmd and cmd.predicate() then
     cmd.perform()
@@ -52,8 +61,10 @@ local function perform(name)
 end
 
 
-function command.perform(...)
-  local ok, res = core.try(perform, ...)
+function command.perform(name, ...)
+  local depth = system.trace_begin(name)
+  local ok, res = core.try(perform, name, ...)
+  system.trace_end(depth)
   return not ok or res
 end
 
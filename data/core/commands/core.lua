@@ -2,11 +2,29 @@ local core = require "core"
 local common = require "core.common"
 local command = require "core.command"
 local keymap = require "core.keymap"
+local profiler = require "core.profiler"
 local LogView = require "core.logview"
 
 
 local fullscreen = false
 
+-- the matcher is rebuilt only when the project's file list changes
+local files_matcher, files_source
+
+local function get_project_files_matcher()
+  if files_source ~= core.project_files then
+    local files = {}
+    for _, item in ipairs(core.project_files) do
+      if item.type == "file" then
+        table.insert(files, item.filename)
+      end
+    end
+    files_matcher = common.fuzzy_matcher(files)
+    files_source = core.project_files
+  end
+  return files_matcher
+end
+
 command.add(nil, {
   ["core:quit"] = function()
     core.quit()
@@ -36,13 +54,13 @@ command.add(nil, {
   end,
 
   ["core:find-command"] = function()
-    local commands = command.get_all_valid()
+    local match = common.fuzzy_matcher(command.get_all_valid())
     core.command_view:enter("Do Command", function(text, item)
       if item then
         command.perform(item.command)
       end
-    end, function(text)
-      local res = common.fuzzy_match(commands, text)
+    end, function(text, max)
+      local res = match(text, max)
       for i, name in ipairs(res) do
         res[i] = {
           text = command.prettify_name(name),
@@ -58,14 +76,8 @@ command.add(nil, {
     core.command_view:enter("Open File From Project", function(text, item)
       text = item and item.text or text
       core.root_view:open_doc(core.open_doc(text))
-    end, function(text)
-      local files = {}
-      for _, item in pairs(core.project_files) do
-        if item.type == "file" then
-          table.insert(files, item.filename)
-        end
-      end
-      return common.fuzzy_match(files, text)
+    end, function(text, max)
+      return get_project_files_matcher()(text, max)
     end)
   end,
 
@@ -84,6 +96,63 @@ command.add(nil, {
     node:add_view(LogView())
   end,
 
+  ["core:log-input-latency"] = function()
+    for name, h in pairs(system.get_input_latency(true)) do
+      -- the bucket holding the 95th percentile, buckets are 1ms wide
+      local p95, n = 0, 0
+      while n < h.count * 0.95 do
+        p95 = p95 + 1
+        n = n + h.buckets[p95]
+      end
+      core.log("%s: %d events, mean %.1fms, 95%% under %dms, max %dms",
+        name, h.count, h.mean, p95, h.max)
+    end
+  end,
+
+  ["core:log-memory-stats"] = function()
+    local stats = system.memory_stats()
+    local mb = 1024 * 1024
+    core.log("Lua memory: %.1fMB in use (%.1fMB small, %.1fMB large), "
+      .. "%.1fMB pooled", stats.total / mb, stats.small / mb, stats.large / mb,
+      stats.pooled / mb)
+    local kinds = {}
+    for kind in pairs(stats.allocations) do table.insert(kinds, kind) end
+    table.sort(kinds)
+    for _, kind in ipairs(kinds) do
+      core.log("%s: %d allocations, %.1fMB", kind, stats.allocations[kind],
+        stats.allocated[kind] / mb)
+    end
+  end,
+
+  ["core:toggle-profiler"] = function()
+    profiler.visible = not profiler.visible
+    core.redraw = true
+  end,
+
+  ["core:export-profile"] = function()
+    core.command_view:set_text("profile.json")
+    core.command_view:enter("Export Profile To", function(filename)
+      local ok, err = profiler.export(filename)
+      if ok then
+        core.log("Exported %d frames to %q", #profiler.frames, filename)
+      else
+        core.error("Can't export profile: %s", err)
+      end
+    end, common.path_suggest)
+  end,
+
+  ["core:export-trace"] = function()
+    core.command_view:set_text("trace.json")
+    core.command_view:enter("Export Trace To", function(filename)
+      local ok, err = system.write_trace(filename)
+      if ok then
+        core.log("Exported trace to %q", filename)
+      else
+        core.error("Can't export trace: %s", err)
+      end
+    end, common.path_suggest)
+  end,
+
   ["core:open-user-module"] = function()
     core.root_view:open_doc(core.open_doc(EXEDIR .. "/data/user/init.lua"))
   end,
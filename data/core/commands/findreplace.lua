@@ -68,7 +68,7 @@ local function find(label, search_fn)
 end
 
 
-local function replace(kind, default, fn)
+local function replace(kind, default, fn, plain)
   core.command_view:set_text(default, true)
 
   core.command_view:enter("Find To Replace " .. kind, function(old)
@@ -78,7 +78,7 @@ local function replace(kind, default, fn)
     core.command_view:enter(s, function(new)
       local n = doc():replace(function(text)
         return fn(text, old, new)
-      end)
+      end, plain and old)
       core.log("Replaced %d instance(s) of %s %q with %q", n, kind, old, new)
     end)
   end)
@@ -141,7 +141,7 @@ command.add("core.docview", {
   ["find-replace:replace"] = function()
     replace("Text", "", function(text, old, new)
       return text:gsub(old:gsub("%W", "%%%1"), new:gsub("%%", "%%%%"), nil)
-    end)
+    end, true)
   end,
 
   ["find-replace:replace-pattern"] = function()
@@ -165,6 +165,6 @@ command.add("core.docview", {
         end
       end)
       return res, n
-    end)
+    end, true)
   end,
 })
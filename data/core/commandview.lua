@@ -84,6 +84,7 @@ function CommandView:move_suggestion_idx(dir)
   self.suggestion_idx = common.clamp(n, 1, #self.suggestions)
   self:complete()
   self.last_change_id = self.doc:get_change_id()
+  self.suggestions_text = self:get_text()
 end
 
 
@@ -95,8 +96,21 @@ end
 
 
 function CommandView:submit()
-  local suggestion = self.suggestions[self.suggestion_idx]
+  -- the suggest job is finished if it can be without waiting on anything,
+  -- else it's dropped; the selected suggestion is only passed on if it was
+  -- suggested for the submitted text
+  if self.last_change_id ~= self.doc:get_change_id() then
+    self:update_suggestions()
+    self.last_change_id = self.doc:get_change_id()
+  end
+  local job = self.suggest_job
+  while job and self.suggest_job == job do
+    if self:step_suggest_job(job) then break end
+  end
+  self.suggest_job = nil
   local text = self:get_text()
+  local suggestion = self.suggestions_text == text
+    and self.suggestions[self.suggestion_idx] or nil
   local submit = self.state.submit
   self:exit(true)
   submit(text, suggestion)
@@ -114,6 +128,7 @@ function CommandView:enter(text, submit, suggest, cancel)
   }
   core.set_active_view(self)
   self:update_suggestions()
+  self.last_change_id = self.doc:get_change_id()
   self.gutter_text_brightness = 100
   self.label = text .. ": "
 end
@@ -127,6 +142,8 @@ function CommandView:exit(submitted, inexplicit)
   self.state = default_state
   self.doc:reset()
   self.suggestions = {}
+  self.suggestions_text = nil
+  self.suggest_job = nil
   if not submitted then cancel(not inexplicit) end
 end
 
@@ -141,8 +158,7 @@ function CommandView:get_suggestion_line_height()
 end
 
 
-function CommandView:update_suggestions()
-  local t = self.state.suggest(self:get_text()) or {}
+function CommandView:set_suggestions(t)
   local res = {}
   for i, item in ipairs(t) do
     if i == max_suggestions then
@@ -154,7 +170,48 @@ function CommandView:update_suggestions()
     res[i] = item
   end
   self.suggestions = res
+  self.suggestion_idx = common.clamp(self.suggestion_idx, 1, #res)
+  core.redraw = true
+end
+
+
+-- resumes the job once, returns the time it asked to wait for
+function CommandView:step_suggest_job(job)
+  local _, res = assert(coroutine.resume(job.co, job.text, max_suggestions))
+  if coroutine.status(job.co) == "dead" then
+    self.suggest_job = nil
+    self.suggestions_text = job.text
+    self:set_suggestions(res or {})
+  elseif type(res) == "table" then
+    self.suggestions_text = job.text
+    self:set_suggestions(res)
+  else
+    return res
+  end
+end
+
+
+-- the suggest callback runs as a background job so slow callbacks never hold
+-- up typing; it may call `coroutine.yield()` to give time back to the editor,
+-- either with a table of partial results to show or with a time to wait. A
+-- newer query replaces the running job, which then stops at its next yield
+function CommandView:update_suggestions()
+  local suggest = self.state.suggest
+  local job = {
+    text = self:get_text(),
+    co = coroutine.create(function(...)
+      local ok, res = core.try(suggest, ...)
+      return ok and res or nil
+    end),
+  }
+  self.suggest_job = job
   self.suggestion_idx = 1
+
+  core.add_thread(function()
+    while self.suggest_job == job do
+      coroutine.yield(self:step_suggest_job(job))
+    end
+  end, job, "interactive")
 end
 
 
@@ -54,48 +54,55 @@ function common.color(str)
 end
 
 
-local function compare_score(a, b)
-  return a.score > b.score
-end
-
-local function fuzzy_match_items(items, needle)
-  local res = {}
-  for _, item in ipairs(items) do
-    local score = system.fuzzy_match(tostring(item), needle)
-    if score then
-      table.insert(res, { text = item, score = score })
-    end
+-- returns a function which fuzzy matches `items` against a needle and returns
+-- the best `max` matching items (or all of them) best first; the items are
+-- only converted to strings once so the matcher can be queried repeatedly
+function common.fuzzy_matcher(items)
+  local strs = {}
+  for i, item in ipairs(items) do
+    strs[i] = tostring(item)
   end
-  table.sort(res, compare_score)
-  for i, item in ipairs(res) do
-    res[i] = item.text
+  local set = system.fuzzy_set(strs)
+  return function(needle, max)
+    local res = set:match(needle, max)
+    for i, idx in ipairs(res) do
+      res[i] = items[idx]
+    end
+    return res
   end
-  return res
 end
 
 
 function common.fuzzy_match(haystack, needle)
   if type(haystack) == "table" then
-    return fuzzy_match_items(haystack, needle)
+    return common.fuzzy_matcher(haystack)(needle)
   end
   return system.fuzzy_match(haystack, needle)
 end
 
 
+-- when run in a coroutine, such as a CommandView suggest job, the matches
+-- found so far are yielded every so many entries stat'ed
 function common.path_suggest(text)
   local path, name = text:match("^(.-)([^/\\]*)$")
   local files = system.list_dir(path == "" and "." or path) or {}
   local res = {}
+  local _, is_main = coroutine.running()
+  local n = 0
+  -- only entries whose name matches need to be stat'ed
+  name = name:lower()
   for _, file in ipairs(files) do
-    file = path .. file
-    local info = system.get_file_info(file)
-    if info then
-      if info.type == "dir" then
-        file = file .. PATHSEP
-      end
-      if file:lower():find(text:lower(), nil, true) == 1 then
+    if file:lower():find(name, nil, true) == 1 then
+      file = path .. file
+      local info = system.get_file_info(file)
+      if info then
+        if info.type == "dir" then
+          file = file .. PATHSEP
+        end
         table.insert(res, file)
       end
+      n = n + 1
+      if n % 100 == 0 and not is_main then coroutine.yield(res) end
     end
   end
   return res
@@ -2,11 +2,20 @@ local config = {}
 
 config.project_scan_rate = 5
 config.fps = 60
+config.thread_starvation_time = 0.25
+config.low_latency_input = true
+config.profiler_frames = 300
+config.gc_pause = 1.5
+config.gc_idle_pause = 1.1
+config.gc_idle_time = 0.5
+config.gc_step_size = 64
+config.gc_generational = false
 config.max_log_items = 80
 config.message_timeout = 3
 config.mouse_wheel_scroll = 50 * SCALE
 config.file_size_limit = 10
 config.ignore_files = "^%."
+config.use_gitignore = true
 config.symbol_pattern = "[%a_][%w_]*"
 config.non_word_chars = " \t\n/\\()\"':,.;<>~!@#$%^&*|+=[]{}`?-"
 config.undo_merge_timeout = 0.3
@@ -1,5 +1,4 @@
 local core = require "core"
-local config = require "core.config"
 local tokenizer = require "core.tokenizer"
 local Object = require "core.object"
 
@@ -15,8 +14,9 @@ function Highlighter:new(doc)
   core.add_thread(function()
     while true do
       if self.first_invalid_line > self.max_wanted_line then
+        -- sleep until lines are invalidated or wanted (see `get_line()`)
         self.max_wanted_line = 0
-        coroutine.yield(1 / config.fps)
+        coroutine.yield(math.huge)
 
       else
         local max = math.min(self.first_invalid_line + 40, self.max_wanted_line)
@@ -34,7 +34,7 @@ function Highlighter:new(doc)
         coroutine.yield()
       end
     end
-  end, self)
+  end, self, "visible")
 end
 
 
@@ -48,6 +48,25 @@ end
 function Highlighter:invalidate(idx)
   self.first_invalid_line = math.min(self.first_invalid_line, idx)
   self.max_wanted_line = math.min(self.max_wanted_line, #self.doc.lines)
+  core.wake_thread(self)
+end
+
+
+-- re-tokenizes the given sorted lines, whose texts changed without adding or
+-- removing a line; the lines after them only need re-tokenizing from the
+-- first one whose end state changed
+function Highlighter:update_lines(lines)
+  local invalid
+  for _, idx in ipairs(lines) do
+    local line = self.lines[idx]
+    if line then
+      self.lines[idx] = self:tokenize_line(idx, line.init_state)
+      if not invalid and self.lines[idx].state ~= line.state then
+        invalid = idx + 1
+      end
+    end
+  end
+  if invalid then self:invalidate(invalid) end
 end
 
 
@@ -67,7 +86,10 @@ function Highlighter:get_line(idx)
     line = self:tokenize_line(idx, prev and prev.state)
     self.lines[idx] = line
   end
-  self.max_wanted_line = math.max(self.max_wanted_line, idx)
+  if idx > self.max_wanted_line then
+    self.max_wanted_line = idx
+    core.wake_thread(self)
+  end
   return line
 end
 
@@ -3,6 +3,7 @@ local Highlighter = require "core.doc.highlighter"
 local syntax = require "core.syntax"
 local config = require "core.config"
 local common = require "core.common"
+local core = require "core"
 
 
 local Doc = Object:extend()
@@ -57,6 +58,8 @@ end
 
 function Doc:reset_syntax()
   local header = self:get_text(1, 1, self:position_offset(1, 1, 128))
+  core.trigger_plugins("files", self.filename or "")
+  core.trigger_plugins("headers", header)
   local syn = syntax.get(self.filename or "", header)
   if self.syntax ~= syn then
     self.syntax = syn
@@ -227,9 +230,11 @@ end
 
 
 local function push_undo(undo_stack, time, type, ...)
-  undo_stack[undo_stack.idx] = { type = type, time = time, ... }
+  local cmd = { type = type, time = time, ... }
+  undo_stack[undo_stack.idx] = cmd
   undo_stack[undo_stack.idx - config.max_undos] = nil
   undo_stack.idx = undo_stack.idx + 1
+  return cmd
 end
 
 
@@ -248,6 +253,9 @@ local function pop_undo(self, undo_stack, redo_stack)
     local line1, col1, line2, col2 = table.unpack(cmd)
     self:raw_remove(line1, col1, line2, col2, redo_stack, cmd.time)
 
+  elseif cmd.type == "lines" then
+    self:raw_set_lines(cmd.lines, cmd.texts, redo_stack, cmd.time)
+
   elseif cmd.type == "selection" then
     self.selection.a.line, self.selection.a.col = cmd[1], cmd[2]
     self.selection.b.line, self.selection.b.col = cmd[3], cmd[4]
@@ -306,6 +314,26 @@ function Doc:raw_remove(line1, col1, line2, col2, undo_stack, time)
 end
 
 
+function Doc:raw_set_lines(lines, texts, undo_stack, time)
+  -- swap in new line texts, keeping the old ones for the undo; `lines` must be
+  -- sorted and none of the texts may add or remove a line break
+  local old_texts = {}
+  for i, idx in ipairs(lines) do
+    old_texts[i] = self.lines[idx]
+    self.lines[idx] = texts[i]
+  end
+
+  -- push undo
+  push_undo(undo_stack, time, "selection", self:get_selection())
+  local cmd = push_undo(undo_stack, time, "lines")
+  cmd.lines, cmd.texts = lines, old_texts
+
+  -- update highlighter and assure selection is in bounds
+  self.highlighter:update_lines(lines)
+  self:sanitize_selection()
+end
+
+
 function Doc:insert(line, col, text)
   self.redo_stack = { idx = 1 }
   line, col = self:sanitize_position(line, col)
@@ -342,7 +370,38 @@ function Doc:text_input(text)
 end
 
 
-function Doc:replace(fn)
+local function replace_lines(self, fn, needle)
+  local lines, texts, n = {}, {}, 0
+  for _, idx in ipairs(system.find_lines(self.lines, needle)) do
+    local old_text = self.lines[idx]
+    local new_text, count = fn(old_text:sub(1, -2))
+    if new_text:find("\n", 1, true) then return end
+    new_text = new_text .. "\n"
+    if new_text ~= old_text then
+      table.insert(lines, idx)
+      table.insert(texts, new_text)
+    end
+    n = n + (count or 0)
+  end
+  if #lines > 0 then
+    self.redo_stack = { idx = 1 }
+    self:raw_set_lines(lines, texts, self.undo_stack, system.get_time())
+  end
+  return n
+end
+
+
+function Doc:replace(fn, needle)
+  -- if every match is known to contain `needle` and to not span lines, only
+  -- the lines containing it are passed to `fn` and changed; a needle spanning
+  -- lines can't be found a line at a time
+  if needle and not needle:find("\n", 1, true)
+  and not self:has_selection()
+  then
+    local n = replace_lines(self, fn, needle)
+    if n then return n end
+  end
+
   local line1, col1, line2, col2, swap
   local had_selection = self:has_selection()
   if had_selection then
@@ -57,6 +57,7 @@ function DocView:new(doc)
   self.doc = assert(doc)
   self.font = "code_font"
   self.last_x_offset = {}
+  self.blink_start = system.get_time()
   self.blink_timer = 0
 end
 
@@ -229,7 +230,7 @@ function DocView:on_mouse_pressed(button, x, y, clicks)
     self.doc:set_selection(mouse_selection(self.doc, clicks, line, col, line, col))
     self.mouse_selecting = { line, col, clicks = clicks }
   end
-  self.blink_timer = 0
+  self.blink_start = system.get_time()
 end
 
 
@@ -269,18 +270,20 @@ function DocView:update()
     if core.active_view == self then
       self:scroll_to_make_visible(line, col)
     end
-    self.blink_timer = 0
+    self.blink_start = system.get_time()
     self.last_line, self.last_col = line, col
   end
 
-  -- update blink timer
+  -- update blink timer, waking up again when the caret next blinks
   if self == core.active_view and not self.mouse_selecting then
     local n = blink_period / 2
     local prev = self.blink_timer
-    self.blink_timer = (self.blink_timer + 1 / config.fps) % blink_period
+    local elapsed = system.get_time() - self.blink_start
+    self.blink_timer = elapsed % blink_period
     if (self.blink_timer > n) ~= (prev > n) then
       core.redraw = true
     end
+    core.wake_at(self.blink_start + (math.floor(elapsed / n) + 1) * n)
   end
 
   DocView.super.update(self)
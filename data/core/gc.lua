@@ -0,0 +1,62 @@
+local config = require "core.config"
+local profiler = require "core.profiler"
+
+-- drives the garbage collector from the main loop, so collection work is done
+-- in the time left over after each frame rather than wherever memory happens
+-- to be allocated. A cycle is started once the heap has grown to
+-- `config.gc_pause` times its size after the last cycle, or to
+-- `config.gc_idle_pause` times once the editor goes idle, and is stepped
+-- until the next frame or thread is due or input arrives. Lua's own collector
+-- is left running behind this; each step done here pays off its debt, so it
+-- only steps in the middle of a frame when allocation outruns the idle time
+local gc = {}
+
+local live = collectgarbage("count")
+local in_cycle = false
+
+
+function gc.init()
+  if config.gc_generational then
+    collectgarbage("generational")
+  end
+end
+
+
+local function step()
+  local start = system.get_time()
+  -- in generational mode each step is a whole (minor or major) collection
+  local done = collectgarbage("step", config.gc_step_size)
+    or config.gc_generational
+  profiler.add_gc_pause(system.get_time() - start)
+  if done then
+    in_cycle = false
+    live = collectgarbage("count")
+  end
+end
+
+
+-- does collection work until `deadline`, the time the main loop would
+-- otherwise wait until
+function gc.run(deadline)
+  local count = collectgarbage("count")
+  -- the collector finished a cycle by itself
+  if count < live then
+    live = count
+    in_cycle = false
+  end
+
+  local idle = deadline - system.get_time() > config.gc_idle_time
+  local pause = idle and config.gc_idle_pause or config.gc_pause
+  if count > live * pause then
+    in_cycle = true
+  end
+
+  while in_cycle and system.get_time() < deadline
+    and not system.has_pending_input()
+  do
+    step()
+  end
+end
+
+
+return gc
@@ -1,7 +1,15 @@
 require "core.strict"
 local common = require "core.common"
 local config = require "core.config"
+
+-- the glyphs of the fonts loaded by core.style are cached across launches
+system.mkdir(EXEDIR .. PATHSEP .. "cache")
+renderer.set_glyph_cache(EXEDIR .. PATHSEP .. "cache")
+
 local style = require "core.style"
+local profiler = require "core.profiler"
+local gc = require "core.gc"
+local startup = require "core.startup"
 local command
 local keymap
 local RootView
@@ -12,6 +20,35 @@ local Doc
 local core = {}
 
 
+-- returns the file `kind` is cached in for the current project, along with the
+-- project's absolute path, which is stored in the cache to validate it
+function core.get_project_cache_filename(kind)
+  local path = system.absolute_path(".") or "."
+  local h = 5381
+  for i = 1, #path do h = (h * 33 + path:byte(i)) % 0x100000000 end
+  local filename = string.format("%s%s%s_%08x", core.cache_dir, PATHSEP, kind, h)
+  return filename, path
+end
+
+
+-- the project's file list is cached between sessions so the file picker and
+-- tree are usable straight away; the first scan validates it in the background
+local function load_project_cache()
+  return system.load_file_list(core.get_project_cache_filename("project"))
+    or {}
+end
+
+
+local function save_project_cache()
+  local filename, path = core.get_project_cache_filename("project")
+  system.mkdir(core.cache_dir)
+  local ok, err = system.save_file_list(filename, core.project_files, path)
+  if not ok then
+    core.log_quiet("Can't save project cache: %s", err)
+  end
+end
+
+
 local function project_scan_thread()
   local function diff_files(a, b)
     if #a ~= #b then return true end
@@ -23,53 +60,256 @@ local function project_scan_thread()
     end
   end
 
+  -- directories are listed before files, each group sorted by name
   local function compare_file(a, b)
+    if (a.type == "dir") ~= (b.type == "dir") then
+      return a.type == "dir"
+    end
     return a.filename < b.filename
   end
 
-  local function get_files(path, t)
+  local function get_file_info(dir, name)
+    if common.match_pattern(name, config.ignore_files) then return end
+    local size_limit = config.file_size_limit * 10e5
+    local file = (dir ~= "." and dir .. PATHSEP or "") .. name
+    local info = system.get_file_info(file)
+    if info and info.size < size_limit
+    and not (config.use_gitignore and system.is_ignored(file, info.type == "dir"))
+    then
+      info.filename = file
+      return info
+    end
+  end
+
+  -- the sorted entries of every scanned directory, keyed by its path; the
+  -- directory monitor (if any) watches each of them
+  local dirs = {}
+  local monitor = dirmonitor.new()
+
+  local function watch(path)
+    if monitor then
+      local ok, err = monitor:watch(path)
+      if not ok then
+        core.log_quiet("Can't watch project directory %q (%s): polling instead",
+          path, err)
+        monitor = nil
+      end
+    end
+  end
+
+  local function insert_info(t, info)
+    local i = 1
+    while t[i] and compare_file(t[i], info) do i = i + 1 end
+    table.insert(t, i, info)
+  end
+
+  function core.is_file_watched(filename)
+    local root = system.absolute_path(".")
+    local abs = system.absolute_path(filename)
+    if not monitor or not root or not abs then return false end
+    if abs:sub(1, #root + 1) ~= root .. PATHSEP then return false end
+    return dirs[abs:sub(#root + 2):match("^(.+)[/\\]") or "."] ~= nil
+  end
+
+  -- directories are watched before they're listed, so nothing created in
+  -- between is missed; the monitor's events for entries that were listed
+  -- anyway are ignored
+  local function scan_dir(path)
     coroutine.yield()
+    watch(path)
+    local t = {}
+    for _, name in ipairs(system.list_dir(path) or {}) do
+      local info = get_file_info(path, name)
+      if info then table.insert(t, info) end
+    end
+    table.sort(t, compare_file)
+    dirs[path] = t
+
+    for _, info in ipairs(t) do
+      if info.type == "dir" then scan_dir(info.filename) end
+    end
+  end
+
+  local function remove_dir(path)
+    local prefix = path .. PATHSEP
+    for k in pairs(dirs) do
+      if k == path or k:sub(1, #prefix) == prefix then
+        dirs[k] = nil
+        if monitor then monitor:unwatch(k) end
+      end
+    end
+  end
+
+  local function get_files(path, t)
     t = t or {}
-    local size_limit = config.file_size_limit * 10e5
-    local all = system.list_dir(path) or {}
-    local dirs, files = {}, {}
-
-    for _, file in ipairs(all) do
-      if not common.match_pattern(file, config.ignore_files) then
-        local file = (path ~= "." and path .. PATHSEP or "") .. file
-        local info = system.get_file_info(file)
-        if info and info.size < size_limit then
-          info.filename = file
-          table.insert(info.type == "dir" and dirs or files, info)
+    for _, info in ipairs(dirs[path]) do
+      table.insert(t, info)
+      if info.type == "dir" then get_files(info.filename, t) end
+    end
+    return t
+  end
+
+  -- scans `path` and everything below it into `dirs`, returns the entries in
+  -- depth-first order
+  local function scan_tree(path)
+    local scan, err = system.scan_tree(path, {
+      ignore = config.ignore_files,
+      size_limit = config.file_size_limit * 10e5,
+      use_ignore_files = config.use_gitignore,
+      monitor = monitor,
+    })
+    if not scan then
+      core.log_quiet("Scanning project in lua: %s", err)
+      scan_dir(path)
+      return get_files(path)
+    end
+
+    -- read the natively scanned tree in chunks and rebuild `dirs` from it.
+    -- The native scan already watched each directory before listing it; it's
+    -- watched again here for the monitor to know its path, which keeps the
+    -- same watch and any events already queued for it
+    local t = {}
+    dirs[path] = {}
+    watch(path)
+    while true do
+      local chunk = scan:read(5000)
+      if not chunk then break end
+      for _, info in ipairs(chunk) do
+        table.insert(t, info)
+        table.insert(dirs[info.filename:match("^(.+)[/\\]") or "."], info)
+        if info.type == "dir" then
+          dirs[info.filename] = {}
+          watch(info.filename)
         end
       end
+      coroutine.yield()
     end
+    return t
+  end
 
-    table.sort(dirs, compare_file)
-    for _, f in ipairs(dirs) do
-      table.insert(t, f)
-      get_files(f.filename, t)
+  -- applies a single monitor event to `dirs`, returns true if an entry was
+  -- added or removed
+  local function apply_event(e)
+    local filename = (e.dir ~= "." and e.dir .. PATHSEP or "") .. e.name
+    core.try(core.on_file_change, e.type, filename)
+
+    local t = dirs[e.dir]
+    if not t then return false end
+    local idx
+    for i, info in ipairs(t) do
+      if info.filename == filename then idx = i break end
     end
 
-    table.sort(files, compare_file)
-    for _, f in ipairs(files) do
-      table.insert(t, f)
+    -- an entry created while its directory was being listed is already there
+    if e.type == "modify" or e.type == "create" and idx then
+      local info = idx and system.get_file_info(filename)
+      if info then
+        t[idx].modified, t[idx].size = info.modified, info.size
+      end
+      return false
     end
 
-    return t
+    if idx then
+      local info = table.remove(t, idx)
+      if info.type == "dir" then remove_dir(info.filename) end
+    end
+    if e.type == "create" then
+      local info = get_file_info(e.dir, e.name)
+      if info then
+        insert_info(t, info)
+        if info.type == "dir" then scan_tree(info.filename) end
+      end
+    end
+    return true
   end
 
-  while true do
-    -- get project files and replace previous table if the new table is
-    -- different
-    local t = get_files(".")
+  -- the cache is written after the first scan if it differed, then at most
+  -- every few seconds while the project keeps changing
+  local cache_dirty, cache_saved = false, -math.huge
+
+  local function save_cache()
+    if cache_dirty and system.get_time() - cache_saved > 5 then
+      save_project_cache()
+      cache_dirty, cache_saved = false, system.get_time()
+    end
+  end
+
+  local function rescan()
+    dirs = {}
+    system.clear_ignore_cache()
+    local t = scan_tree(".")
+    -- replace previous table if the new table is different
     if diff_files(core.project_files, t) then
       core.project_files = t
       core.redraw = true
+      cache_dirty = true
     end
+  end
+
+  rescan()
 
-    -- wait for next scan
-    coroutine.yield(config.project_scan_rate)
+  while true do
+    save_cache()
+    if monitor then
+      -- update incrementally from the monitor's events
+      coroutine.yield(0.1)
+      local changed, rescan_all = false, false
+      for _, e in ipairs(monitor:read()) do
+        if e.type == "overflow" then
+          rescan_all = true
+        elseif apply_event(e) then
+          changed = true
+        end
+        if config.use_gitignore
+        and (e.name == ".gitignore" or e.name == ".ignore") then
+          rescan_all = true
+        end
+      end
+      if rescan_all then
+        rescan()
+      elseif changed then
+        core.project_files = get_files(".")
+        core.redraw = true
+        cache_dirty = true
+      end
+    else
+      -- no monitor: wait for next full scan
+      coroutine.yield(config.project_scan_rate)
+      rescan()
+    end
+  end
+end
+
+
+-- loads the plugins, the user module and the project module, then starts
+-- scanning the project
+local function load_rest()
+  coroutine.yield()
+  local got_plugin_error = not core.load_plugins()
+  coroutine.yield()
+  local got_user_error = not core.try(require, "user")
+  coroutine.yield()
+  local stage = startup.begin("project module")
+  local got_project_error = not core.load_project_module()
+  startup.finish(stage)
+
+  -- the scan reads the ignore settings, which the user and project modules
+  -- may have changed; until it's done the cached file list is used
+  core.add_thread(project_scan_thread)
+
+  -- the docs were opened before the plugins which highlight them were loaded
+  for _, doc in ipairs(core.docs) do
+    doc:reset_syntax()
+  end
+
+  if got_plugin_error or got_user_error or got_project_error then
+    command.perform("core:open-log")
+  end
+  startup.report()
+
+  local bench_script = os.getenv("LITE_BENCH")
+  if bench_script then
+    require("core.bench").run(bench_script)
   end
 end
 
@@ -95,12 +335,16 @@ function core.init()
 
   system.chdir(project_dir)
 
+  gc.init()
+  core.cache_dir = EXEDIR .. PATHSEP .. "cache"
   core.frame_start = 0
+  core.wake_time = math.huge
   core.clip_rect_stack = {{ 0,0,0,0 }}
   core.log_items = {}
   core.docs = {}
+  core.lazy_plugins = {}
   core.threads = setmetatable({}, { __mode = "k" })
-  core.project_files = {}
+  core.project_files = load_project_cache()
   core.redraw = true
 
   core.root_view = RootView()
@@ -110,19 +354,16 @@ function core.init()
   core.root_view.root_node:split("down", core.command_view, true)
   core.root_view.root_node.b:split("down", core.status_view, true)
 
-  core.add_thread(project_scan_thread)
   command.add_defaults()
-  local got_plugin_error = not core.load_plugins()
-  local got_user_error = not core.try(require, "user")
-  local got_project_error = not core.load_project_module()
 
   for _, filename in ipairs(files) do
     core.root_view:open_doc(core.open_doc(filename))
   end
 
-  if got_plugin_error or got_user_error or got_project_error then
-    command.perform("core:open-log")
-  end
+  -- the rest is loaded once the first frame has been shown, yielding between
+  -- each part so the window is drawn and responds to input in the meantime
+  core.add_thread(load_rest, nil, "interactive")
+  startup.first_frame = startup.begin("first frame")
 end
 
 
@@ -172,15 +413,57 @@ function core.quit(force)
 end
 
 
+local function load_plugin(modname)
+  local depth = system.trace_begin("load " .. modname)
+  local ok = core.try(require, modname)
+  system.trace_end(depth)
+  if ok then
+    core.log_quiet("Loaded plugin %q", modname)
+  end
+  return ok
+end
+
+
+-- reads a plugin's manifest: a table of the triggers which load the plugin,
+-- given in a comment at the top of the file starting with `-- lazy:` and
+-- carrying on over any comment lines following it
+local function read_manifest(filename)
+  local fp = io.open(filename, "rb")
+  if not fp then return end
+  local text = (fp:read("*l") or ""):match("^%-%-%s*lazy:(.*)")
+  while text do
+    local more = (fp:read("*l") or ""):match("^%-%-(.*)")
+    if not more then break end
+    text = text .. "\n" .. more
+  end
+  fp:close()
+  if not text then return end
+  local fn, err = load("return " .. text, "=" .. filename, "t", {})
+  if not fn then error("Error in plugin manifest:\n\t" .. err) end
+  return fn()
+end
+
+
+-- plugins with a manifest are not loaded until one of their triggers is hit;
+-- see core.trigger_plugins
 function core.load_plugins()
   local no_errors = true
   local files = system.list_dir(EXEDIR .. "/data/plugins")
   for _, filename in ipairs(files) do
     local modname = "plugins." .. filename:gsub(".lua$", "")
-    local ok = core.try(require, modname)
-    if ok then
-      core.log_quiet("Loaded plugin %q", modname)
-    else
+    local path = EXEDIR .. "/data/plugins/" .. filename
+    local ok, manifest = core.try(read_manifest, path)
+    if ok and manifest then
+      manifest.name = modname
+      for _, kind in ipairs { "commands", "events" } do
+        if type(manifest[kind]) == "string" then
+          manifest[kind] = { manifest[kind] }
+        end
+      end
+      keymap.add(manifest.keys or {})
+      table.insert(core.lazy_plugins, manifest)
+      core.log_quiet("Deferred plugin %q", modname)
+    elseif not load_plugin(modname) then
       no_errors = false
     end
   end
@@ -188,6 +471,40 @@ function core.load_plugins()
 end
 
 
+local function has_trigger(plugin, kind, value)
+  local triggers = plugin[kind]
+  if not triggers then return false end
+  if kind == "files" or kind == "headers" then
+    return common.match_pattern(value, triggers)
+  end
+  for _, name in ipairs(triggers) do
+    if name == value then return true end
+  end
+  return false
+end
+
+
+-- loads the deferred plugins with a trigger of `kind` matching `value`: a
+-- filename or file header matching their `files` or `headers` patterns, or
+-- one of their `commands` or `events` by name. A plugin's `keys` are bound
+-- when its manifest is read, so pressing one performs a trigger command.
+-- Returns true if any plugin was loaded
+function core.trigger_plugins(kind, value)
+  local matched = {}
+  for i = #core.lazy_plugins, 1, -1 do
+    local plugin = core.lazy_plugins[i]
+    if has_trigger(plugin, kind, value) then
+      table.remove(core.lazy_plugins, i)
+      table.insert(matched, 1, plugin)
+    end
+  end
+  for _, plugin in ipairs(matched) do
+    load_plugin(plugin.name)
+  end
+  return #matched > 0
+end
+
+
 function core.load_project_module()
   local filename = ".lite_project.lua"
   if system.get_file_info(filename) then
@@ -213,6 +530,20 @@ function core.reload_module(name)
 end
 
 
+-- called by the project scan thread when the directory monitor reports that a
+-- file in the project was created, deleted or modified; plugins can wrap this
+-- to react to changes without polling
+function core.on_file_change(type, filename)
+end
+
+
+-- returns true if changes to `filename` are reported to core.on_file_change,
+-- which is the case while the directory monitor watches its directory
+function core.is_file_watched(filename)
+  return false
+end
+
+
 function core.set_active_view(view)
   assert(view, "Tried to set active view to nil")
   if view ~= core.active_view then
@@ -222,10 +553,132 @@ function core.set_active_view(view)
 end
 
 
-function core.add_thread(f, weak_ref)
-  local key = weak_ref or #core.threads + 1
+-- threads waiting to run are kept in a min-heap ordered by wake time. The heap
+-- only references them weakly, so that a thread added with a `weak_ref` is
+-- still dropped once its ref is collected; the holes this leaves are looked
+-- for before each pass over the threads, and the heap is then rebuilt from
+-- `core.threads`
+local thread_heap = setmetatable({ n = 0 }, { __mode = "v" })
+local thread_heap_broken = false
+local thread_count = 0
+
+core.thread_priorities = { interactive = 1, visible = 2, background = 3, idle = 4 }
+
+
+local function swap_threads(i, j)
+  local h = thread_heap
+  h[i], h[j] = h[j], h[i]
+  h[i].index, h[j].index = i, j
+end
+
+
+local function sift_thread_up(i)
+  local h = thread_heap
+  while i > 1 do
+    local parent = math.floor(i / 2)
+    if not h[i] or not h[parent] then
+      thread_heap_broken = true
+      return
+    end
+    if h[parent].wake <= h[i].wake then return end
+    swap_threads(i, parent)
+    i = parent
+  end
+end
+
+
+local function sift_thread_down(i)
+  local h = thread_heap
+  while true do
+    local min = i
+    for child = i * 2, math.min(i * 2 + 1, h.n) do
+      if not h[child] or not h[min] then
+        thread_heap_broken = true
+        return
+      end
+      if h[child].wake < h[min].wake then min = child end
+    end
+    if min == i then return end
+    swap_threads(i, min)
+    i = min
+  end
+end
+
+
+local function push_thread(thread)
+  local h = thread_heap
+  h.n = h.n + 1
+  h[h.n] = thread
+  thread.index = h.n
+  sift_thread_up(h.n)
+end
+
+
+local function pop_thread()
+  local h = thread_heap
+  local thread = h[1]
+  h[1] = h[h.n]
+  h[h.n] = nil
+  h.n = h.n - 1
+  if h[1] then h[1].index = 1 end
+  sift_thread_down(1)
+  return thread
+end
+
+
+local function rebuild_thread_heap()
+  for i = 1, thread_heap.n do thread_heap[i] = nil end
+  thread_heap.n = 0
+  thread_heap_broken = false
+  for _, thread in pairs(core.threads) do push_thread(thread) end
+end
+
+
+local function check_thread_heap()
+  for i = 1, thread_heap.n do
+    if not thread_heap[i] then
+      thread_heap_broken = true
+      return
+    end
+  end
+end
+
+
+-- `priority` is one of the names in `core.thread_priorities`, "background" by
+-- default: threads are run in order of priority within each frame's budget
+function core.add_thread(f, weak_ref, priority)
+  priority = priority or "background"
+  assert(core.thread_priorities[priority], "unknown thread priority")
+  thread_count = thread_count + 1
+  local key = weak_ref or thread_count
   local fn = function() return core.try(f) end
-  core.threads[key] = { cr = coroutine.create(fn), wake = 0 }
+  local info = debug.getinfo(f, "S")
+  if core.threads[key] then core.threads[key].dead = true end
+  local thread = {
+    cr = coroutine.create(fn),
+    key = key,
+    name = info.short_src .. ":" .. info.linedefined,
+    priority = core.thread_priorities[priority],
+    wake = system.get_time(),
+    time = 0,
+    runs = 0,
+  }
+  core.threads[key] = thread
+  push_thread(thread)
+end
+
+
+-- makes the thread added with `weak_ref` due right away if it is waiting, so
+-- threads can wait indefinitely for work instead of polling for it
+function core.wake_thread(weak_ref)
+  local thread = core.threads[weak_ref]
+  local now = system.get_time()
+  if thread and thread.wake > now then
+    thread.wake = now
+    if thread_heap[thread.index] == thread then
+      sift_thread_up(thread.index)
+    end
+  end
 end
 
 
@@ -324,6 +777,7 @@ end
 
 function core.on_event(type, ...)
   local did_keymap = false
+  core.trigger_plugins("events", type)
   if type == "textinput" then
     core.root_view:on_text_input(...)
   elseif type == "keypressed" then
@@ -380,12 +834,15 @@ function core.step()
   if mouse_moved then
     core.try(core.on_event, "mousemoved", mouse.x, mouse.y, mouse.dx, mouse.dy)
   end
+  profiler.mark("events")
 
   local width, height = renderer.get_size()
 
   -- update
   core.root_view.size.x, core.root_view.size.y = width, height
   core.root_view:update()
+  profiler.mark("update")
+  if profiler.visible then core.redraw = true end
   if not core.redraw then return false end
   core.redraw = false
 
@@ -411,63 +868,126 @@ function core.step()
   core.clip_rect_stack[1] = { 0, 0, width, height }
   renderer.set_clip_rect(table.unpack(core.clip_rect_stack[1]))
   core.root_view:draw()
+  if profiler.visible then profiler.draw(width) end
+  profiler.mark("draw")
   renderer.end_frame()
+  profiler.add_render_stats()
   return true
 end
 
 
-local run_threads = coroutine.wrap(function()
-  while true do
-    local max_time = 1 / config.fps - 0.004
-    local ran_any_threads = false
-
-    for k, thread in pairs(core.threads) do
-      -- run thread
-      if thread.wake < system.get_time() then
-        local _, wait = assert(coroutine.resume(thread.cr))
-        if coroutine.status(thread.cr) == "dead" then
-          if type(k) == "number" then
-            table.remove(core.threads, k)
-          else
-            core.threads[k] = nil
-          end
-        elseif wait then
-          thread.wake = system.get_time() + wait
-        end
-        ran_any_threads = true
-      end
+local function run_thread(thread, now)
+  local depth = system.trace_begin(thread.name)
+  local _, wait = assert(coroutine.resume(thread.cr))
+  system.trace_end(depth)
+  local time = system.get_time()
+  thread.time = thread.time + (time - now)
+  thread.runs = thread.runs + 1
+  profiler.add_thread_time(thread.name, time - now)
+  if coroutine.status(thread.cr) == "dead" then
+    thread.dead = true
+    if core.threads[thread.key] == thread then core.threads[thread.key] = nil end
+  else
+    thread.wake = time + (wait or 0)
+  end
+  return time
+end
 
-      -- stop running threads if we're about to hit the end of frame
-      if system.get_time() - core.frame_start > max_time then
-        coroutine.yield()
-      end
+
+-- runs the threads that are due until the frame's budget is used up. Due
+-- threads are run in order of priority, each class in order of wake time; a
+-- thread that has been due for longer than `config.thread_starvation_time`
+-- runs right after the interactive threads, and the first such thread runs
+-- even when the budget is already used up, so no thread is starved forever.
+-- Returns the time the next thread is due
+local function run_threads()
+  local now = system.get_time()
+  local deadline = core.frame_start + 1 / config.fps - 0.004
+  check_thread_heap()
+  if thread_heap_broken then rebuild_thread_heap() end
+
+  local due = { {}, {}, {}, {} }
+  local starving = {}
+  while thread_heap.n > 0 and thread_heap[1] and thread_heap[1].wake <= now do
+    local thread = pop_thread()
+    if thread and not thread.dead then
+      local starved = now - thread.wake > config.thread_starvation_time
+      table.insert(starved and starving or due[thread.priority], thread)
     end
+  end
 
-    if not ran_any_threads then coroutine.yield() end
+  local ran_starving, preempted = false, false
+  for _, list in ipairs { due[1], starving, due[2], due[3], due[4] } do
+    for _, thread in ipairs(list) do
+      local run = now < deadline and not preempted
+        or (list == starving and not ran_starving)
+      if run and not thread.dead then
+        ran_starving = ran_starving or list == starving
+        now = run_thread(thread, now)
+        -- in low latency mode the pass is cut short by pending input, so that
+        -- the input is handled and drawn without waiting on the threads
+        preempted = config.low_latency_input and system.has_pending_input()
+      end
+      if not thread.dead then push_thread(thread) end
+    end
   end
-end)
+
+  -- a thread collected during the pass may have left a hole at the root
+  check_thread_heap()
+  if thread_heap_broken then rebuild_thread_heap() end
+  return thread_heap[1] and thread_heap[1].wake or math.huge
+end
+
+
+-- asks the main loop to update again no later than `time`; views with time
+-- based animations call this from their `update()` each frame
+function core.wake_at(time)
+  core.wake_time = math.min(core.wake_time, time)
+end
 
 
 function core.run()
   while true do
+    profiler.begin_frame()
     core.frame_start = system.get_time()
+    core.wake_time = math.huge
+    local depth = system.trace_begin("step")
     local did_redraw = core.step()
-    run_threads()
-    if not did_redraw and not system.window_has_focus() then
-      system.wait_event(0.25)
+    system.trace_end(depth)
+    if did_redraw then startup.frame_shown() end
+    depth = system.trace_begin("threads")
+    local wake = math.min(run_threads(), core.wake_time)
+    system.trace_end(depth)
+    profiler.mark("threads")
+
+    -- keep drawing at the frame rate while something is changing, otherwise
+    -- block until there is input or something is due
+    if did_redraw or core.redraw then
+      wake = math.min(wake, core.frame_start + 1 / config.fps)
+    end
+
+    -- collect garbage in the time left until then
+    depth = system.trace_begin("gc")
+    gc.run(wake - 0.001)
+    system.trace_end(depth)
+    profiler.mark("gc")
+    profiler.end_frame()
+
+    local timeout = wake - system.get_time()
+    if timeout > 0 then
+      system.wait_event(timeout < math.huge and timeout or nil)
     end
-    local elapsed = system.get_time() - core.frame_start
-    system.sleep(math.max(0, 1 / config.fps - elapsed))
   end
 end
 
 
 function core.on_error(err)
-  -- write error to file
+  -- write error to file, along with a trace of what led up to it
   local fp = io.open(EXEDIR .. "/error.txt", "wb")
   fp:write("Error: " .. tostring(err) .. "\n")
   fp:write(debug.traceback(nil, 4))
   fp:close()
+  system.write_trace(EXEDIR .. "/error_trace.json")
   -- save copy of all unsaved documents
   for _, doc in ipairs(core.docs) do
     if doc:is_dirty() and doc.filename then
@@ -0,0 +1,221 @@
+local common = require "core.common"
+local config = require "core.config"
+local style = require "core.style"
+
+-- records how long each part of the main loop takes, keeping the last
+-- `config.profiler_frames` frames. Each pass of the main loop is a frame, whose
+-- sections are timed by `profiler.mark()` with the time since the previous
+-- mark; the renderer's own timings are added after drawing and the scheduler
+-- adds the time spent in each thread
+local profiler = {}
+
+profiler.sections = {
+  "events", "update", "draw", "hash", "raster", "present", "threads", "gc"
+}
+profiler.frames = {}
+profiler.visible = false
+
+local colors = {
+  events  = { common.color "#93DDFA" },
+  update  = { common.color "#E58AC9" },
+  draw    = { common.color "#F77483" },
+  hash    = { common.color "#FFA94D" },
+  raster  = { common.color "#f7c95c" },
+  present = { common.color "#97979c" },
+  threads = { common.color "#6fbf73" },
+  gc      = { common.color "#b48ead" },
+}
+
+local frame
+local last_mark = 0
+local next_frame = 1
+
+
+function profiler.begin_frame()
+  -- reuse the table of the frame being replaced
+  frame = profiler.frames[next_frame] or { thread_times = {} }
+  for _, name in ipairs(profiler.sections) do frame[name] = 0 end
+  for name in pairs(frame.thread_times) do frame.thread_times[name] = nil end
+  frame.rects = 0
+  frame.gc_pause = 0
+  frame.start = system.get_time()
+  last_mark = frame.start
+end
+
+
+function profiler.mark(section)
+  local time = system.get_time()
+  frame[section] = frame[section] + (time - last_mark)
+  last_mark = time
+end
+
+
+function profiler.add_render_stats()
+  local stats = renderer.get_stats()
+  frame.hash = stats.hash_time
+  frame.raster = stats.draw_time
+  frame.present = stats.present_time
+  frame.rects = stats.rects
+  last_mark = system.get_time()
+end
+
+
+function profiler.add_thread_time(name, time)
+  frame.thread_times[name] = (frame.thread_times[name] or 0) + time
+end
+
+
+-- records a single step of garbage collection, the longest of which is the
+-- frame's GC pause
+function profiler.add_gc_pause(time)
+  frame.gc_pause = math.max(frame.gc_pause, time)
+end
+
+
+function profiler.end_frame()
+  frame.total = system.get_time() - frame.start
+  frame.memory = collectgarbage("count") * 1024
+  profiler.frames[next_frame] = frame
+  next_frame = next_frame % config.profiler_frames + 1
+end
+
+
+function profiler.last_frame()
+  return profiler.frames[(next_frame - 2) % config.profiler_frames + 1]
+end
+
+
+-- iterates the recorded frames from oldest to newest
+function profiler.each_frame()
+  local frames, count = profiler.frames, #profiler.frames
+  local first = count < config.profiler_frames and 1 or next_frame
+  local i = 0
+  return function()
+    i = i + 1
+    if i <= count then
+      return i, frames[(first + i - 2) % count + 1]
+    end
+  end
+end
+
+
+function profiler.draw(width)
+  local font = style.code_font
+  local bar_width = math.max(1, common.round(2 * SCALE))
+  local graph_h = common.round(100 * SCALE)
+  local line_h = font:get_height()
+  local w = common.round(300 * SCALE)
+  local x = width - w - style.padding.x
+  local y = style.padding.y
+
+  -- average the sections and threads over the shown frames
+  local shown = math.floor(w / bar_width)
+  local first = math.max(1, #profiler.frames - shown + 1)
+  local avg, threads, n = {}, {}, 0
+  local gc_pause, memory = 0, 0
+  for i, f in profiler.each_frame() do
+    if i >= first then
+      n = n + 1
+      gc_pause = math.max(gc_pause, f.gc_pause)
+      memory = f.memory
+      for _, name in ipairs(profiler.sections) do
+        avg[name] = (avg[name] or 0) + f[name]
+      end
+      for name, time in pairs(f.thread_times) do
+        threads[name] = (threads[name] or 0) + time
+      end
+    end
+  end
+  local slowest = {}
+  for name, time in pairs(threads) do
+    table.insert(slowest, { name = name, time = time })
+  end
+  table.sort(slowest, function(a, b) return a.time > b.time end)
+
+  local per_frame = 1000 / math.max(n, 1)
+  local rows = #profiler.sections + 1 + math.min(#slowest, 3)
+  local h = graph_h + rows * line_h + style.padding.y * 2
+  renderer.draw_rect(x, y, w, h, style.background2)
+
+  -- stacked bars for each frame, newest on the right, the height of the
+  -- graph being two frames' budget
+  local scale = graph_h / (2 / config.fps)
+  local bx = x + w - n * bar_width
+  for i, f in profiler.each_frame() do
+    if i >= first then
+      local by = y + graph_h
+      for _, name in ipairs(profiler.sections) do
+        local bh = math.min(f[name] * scale, by - y)
+        if bh >= 1 then
+          renderer.draw_rect(bx, by - bh, bar_width, bh, colors[name])
+          by = by - bh
+        end
+      end
+      bx = bx + bar_width
+    end
+  end
+  renderer.draw_rect(x, y + graph_h / 2, w, style.divider_size, style.dim)
+
+  -- the legend, with each section's and the slowest threads' average time
+  local ty = y + graph_h + style.padding.y
+  local tx = x + style.padding.x
+  for _, name in ipairs(profiler.sections) do
+    local time = (avg[name] or 0) * per_frame
+    local text = string.format("%-8s %6.2fms", name, time)
+    renderer.draw_rect(x, ty, style.padding.x / 2, line_h, colors[name])
+    renderer.draw_text(font, text, tx, ty, style.text)
+    ty = ty + line_h
+  end
+  local text = string.format("heap %.1fMB, longest gc step %.2fms",
+    memory / (1024 * 1024), gc_pause * 1000)
+  renderer.draw_text(font, text, tx, ty, style.dim)
+  ty = ty + line_h
+  for i = 1, math.min(#slowest, 3) do
+    local t = slowest[i]
+    local text = string.format("%6.2fms %s", t.time * per_frame, t.name)
+    renderer.draw_text(font, text, tx, ty, style.dim)
+    ty = ty + line_h
+  end
+end
+
+
+-- returns `s` as a quoted JSON string
+function profiler.json_string(s)
+  return '"' .. s:gsub('[%c"\\]', function(c)
+    return string.format("\\u%04x", c:byte())
+  end) .. '"'
+end
+
+
+-- writes the recorded frames to `filename` as a JSON array, with each frame's
+-- start time, total, section times and longest GC step in seconds, the bytes
+-- in use by Lua and the time spent in each thread by the thread's name in
+-- `thread_times`
+function profiler.export(filename)
+  local fp, err = io.open(filename, "wb")
+  if not fp then return false, err end
+  fp:write("[\n")
+  for i, f in profiler.each_frame() do
+    local fields = {
+      string.format('"start": %.6f', f.start),
+      string.format('"total": %.6f', f.total),
+      string.format('"gc_pause": %.6f', f.gc_pause),
+      string.format('"memory": %d', f.memory),
+    }
+    for _, name in ipairs(profiler.sections) do
+      table.insert(fields, string.format('"%s": %.6f', name, f[name]))
+    end
+    local times = {}
+    for name, time in pairs(f.thread_times) do
+      table.insert(times, string.format("%s: %.6f", profiler.json_string(name), time))
+    end
+    table.insert(fields, '"thread_times": {' .. table.concat(times, ", ") .. "}")
+    fp:write(i > 1 and ",\n" or "", "{", table.concat(fields, ", "), "}")
+  end
+  fp:write("\n]\n")
+  fp:close()
+  return true
+end
+
+
+return profiler
@@ -0,0 +1,103 @@
+-- records where the time goes from launch until everything is loaded: the
+-- stages main.c leaves in STARTUP, every module loaded by `require`, the wait
+-- for the first frame to be shown and any other stage wrapped in
+-- startup.begin and startup.finish. Once startup is over the stages are logged
+-- as a table, and printed to stdout as JSON if LITE_STARTUP_JSON is set
+local startup = {}
+
+startup.stages = {}
+startup.done = false
+
+local start = STARTUP[1] and STARTUP[1].time or system.get_time()
+local depth = 0
+local require = require
+
+for i = 2, #STARTUP do
+  table.insert(startup.stages, {
+    name = STARTUP[i].name,
+    start = STARTUP[i - 1].time - start,
+    time = STARTUP[i].time - STARTUP[i - 1].time,
+    depth = 0,
+  })
+end
+
+
+-- returns the stage to pass to startup.finish, or nil once startup is done
+function startup.begin(name)
+  if startup.done then return end
+  local stage = { name = name, start = system.get_time() - start, depth = depth }
+  table.insert(startup.stages, stage)
+  depth = depth + 1
+  return stage
+end
+
+
+function startup.finish(stage)
+  if not stage then return end
+  stage.time = system.get_time() - start - stage.start
+  depth = stage.depth
+end
+
+
+-- modules are timed as they are loaded, including the time taken by any
+-- modules they load in turn
+_G.require = function(name)
+  if startup.done or package.loaded[name] then
+    return require(name)
+  end
+  local stage = startup.begin(name)
+  local ok, res = pcall(require, name)
+  startup.finish(stage)
+  if not ok then error(res, 0) end
+  return res
+end
+
+
+local function json(total)
+  local json_string = require("core.profiler").json_string
+  local stages = {}
+  for _, s in ipairs(startup.stages) do
+    table.insert(stages, string.format(
+      '{"name": %s, "start": %.6f, "time": %.6f, "depth": %d}',
+      json_string(s.name), s.start, s.time or -1, s.depth))
+  end
+  return string.format('{"total": %.6f, "stages": [%s]}',
+    total, table.concat(stages, ", "))
+end
+
+
+-- called for each frame shown, the first of which ends the first frame stage
+function startup.frame_shown()
+  local stage = startup.first_frame
+  if stage and not stage.time then
+    startup.finish(stage)
+  end
+end
+
+
+-- called once everything is loaded, ends startup and reports it
+function startup.report()
+  if startup.done then return end
+  local core = require "core"
+  startup.done = true
+  _G.require = require
+
+  local total = system.get_time() - start
+  local lines = { "   start    time" }
+  for _, s in ipairs(startup.stages) do
+    local time = s.time and string.format("%7.2f", s.time * 1000) or "      ?"
+    table.insert(lines, string.format("%8.2f %s  %s%s", s.start * 1000, time,
+      string.rep("  ", s.depth), s.name))
+  end
+  local first_frame = startup.first_frame
+  local item = core.log_quiet("Started in %.2fms, first frame shown at %.2fms",
+    total * 1000, first_frame and (first_frame.start + first_frame.time) * 1000)
+  item.info = table.concat(lines, "\n")
+
+  if os.getenv("LITE_STARTUP_JSON") then
+    print(json(total))
+  end
+end
+
+
+return startup
@@ -7,6 +7,7 @@ local keymap = require "core.keymap"
 local translate = require "core.doc.translate"
 local RootView = require "core.rootview"
 local DocView = require "core.docview"
+local Doc = require "core.doc"
 
 config.autocomplete_max_suggestions = 6
 
@@ -26,60 +27,104 @@ function autocomplete.add(t)
 end
 
 
-core.add_thread(function()
-  local cache = setmetatable({}, { __mode = "k" })
-
-  local function get_symbols(doc)
-    local i = 1
-    local s = {}
-    while i < #doc.lines do
-      for sym in doc.lines[i]:gmatch(config.symbol_pattern) do
-        s[sym] = true
-      end
-      i = i + 1
-      if i % 100 == 0 then coroutine.yield() end
+-- the symbols of all open docs, kept up to date line by line as docs change;
+-- other plugins may add their own docs to the index, or add indexes of their
+-- own which are queried along with it
+local symbol_index
+local symbol_indexes = {}
+local doc_symbols = setmetatable({}, { __mode = "k" })
+
+function autocomplete.get_symbol_index()
+  if symbol_index == nil then
+    local err
+    symbol_index, err = system.symbol_index(config.symbol_pattern)
+    if not symbol_index then
+      core.error("Can't index symbols: %s", err)
+      symbol_index = false
     end
-    return s
   end
+  return symbol_index or nil
+end
 
-  local function cache_is_valid(doc)
-    local c = cache[doc]
-    return c and c.last_change_id == doc:get_change_id()
+function autocomplete.add_symbol_index(index)
+  table.insert(symbol_indexes, index)
+end
+
+local function update_symbols(doc, line, remove, insert)
+  local symbols = doc_symbols[doc]
+  if symbols then
+    symbols:splice(doc.lines, line, remove, insert)
   end
+end
 
-  while true do
-    local symbols = {}
+local function reset_symbols(doc)
+  local symbols = doc_symbols[doc]
+  if symbols then
+    symbols:splice(doc.lines, 1, symbols:get_line_count(), #doc.lines)
+  end
+end
+
+
+local raw_insert = Doc.raw_insert
+local raw_remove = Doc.raw_remove
+local raw_set_lines = Doc.raw_set_lines
+local load = Doc.load
+local reset = Doc.reset
+
+function Doc:raw_insert(line, col, text, ...)
+  raw_insert(self, line, col, text, ...)
+  local _, n = text:gsub("\n", "")
+  update_symbols(self, line, 1, n + 1)
+end
+
+function Doc:raw_remove(line1, col1, line2, col2, ...)
+  raw_remove(self, line1, col1, line2, col2, ...)
+  update_symbols(self, line1, line2 - line1 + 1, 1)
+end
+
+function Doc:raw_set_lines(lines, ...)
+  raw_set_lines(self, lines, ...)
+  for _, line in ipairs(lines) do
+    update_symbols(self, line, 1, 1)
+  end
+end
+
+function Doc:load(...)
+  load(self, ...)
+  reset_symbols(self)
+end
+
+function Doc:reset(...)
+  reset(self, ...)
+  reset_symbols(self)
+end
 
-    -- lift all symbols from all docs
+
+core.add_thread(function()
+  local symbol_index = autocomplete.get_symbol_index()
+  if not symbol_index then return end
+
+  while true do
+    -- index newly opened docs
+    local open = {}
     for _, doc in ipairs(core.docs) do
-      -- update the cache if the doc has changed since the last iteration
-      if not cache_is_valid(doc) then
-        cache[doc] = {
-          last_change_id = doc:get_change_id(),
-          symbols = get_symbols(doc)
-        }
-      end
-      -- update symbol set with doc's symbol set
-      for sym in pairs(cache[doc].symbols) do
-        symbols[sym] = true
+      open[doc] = true
+      if not doc_symbols[doc] then
+        doc_symbols[doc] = symbol_index:new_doc()
+        reset_symbols(doc)
+        coroutine.yield()
       end
-      coroutine.yield()
     end
 
-    -- update symbols list
-    autocomplete.add { name = "open-docs", items = symbols }
-
-    -- wait for next scan
-    local valid = true
-    while valid do
-      coroutine.yield(1)
-      for _, doc in ipairs(core.docs) do
-        if not cache_is_valid(doc) then
-          valid = false
-        end
+    -- drop the symbols of closed docs
+    for doc, symbols in pairs(doc_symbols) do
+      if not open[doc] then
+        symbols:splice(doc.lines, 1, symbols:get_line_count(), 0)
+        doc_symbols[doc] = nil
       end
     end
 
+    coroutine.yield(1)
   end
 end)
 
@@ -96,30 +141,71 @@ local function reset_suggestions()
 end
 
 
-local function update_suggestions()
-  local doc = core.active_view.doc
-  local filename = doc and doc.filename or ""
+-- the matcher is kept while the same item lists apply, so that typing more of
+-- a symbol only narrows down the previous matches
+local matcher, matcher_sources = nil, {}
 
-  -- get all relevant suggestions for given filename
-  local items = {}
+local function get_matcher(filename)
+  -- get all relevant suggestion lists for given filename
+  local sources = {}
   for _, v in pairs(autocomplete.map) do
     if common.match_pattern(filename, v.files) then
+      table.insert(sources, v)
+    end
+  end
+
+  local changed = not matcher or #sources ~= #matcher_sources
+  for i, v in ipairs(sources) do
+    changed = changed or v ~= matcher_sources[i]
+  end
+  if changed then
+    local items = {}
+    for _, v in ipairs(sources) do
       for _, item in pairs(v.items) do
         table.insert(items, item)
       end
     end
+    matcher, matcher_sources = common.fuzzy_matcher(items), sources
   end
+  return matcher
+end
 
-  -- fuzzy match, remove duplicates and store
-  items = common.fuzzy_match(items, partial)
-  local j = 1
-  for i = 1, config.autocomplete_max_suggestions do
-    suggestions[i] = items[j]
-    while items[j] and items[i].text == items[j].text do
-      items[i].info = items[i].info or items[j].info
-      j = j + 1
+
+local function update_suggestions()
+  local doc = core.active_view.doc
+  local filename = doc and doc.filename or ""
+  local max = config.autocomplete_max_suggestions
+
+  -- fuzzy match the item lists and the symbol indexes, skipping the symbol
+  -- being typed, and order them all by score
+  local items = get_matcher(filename)(partial, max * 2)
+  local indexes = { table.unpack(symbol_indexes) }
+  if symbol_index then table.insert(indexes, 1, symbol_index) end
+  for _, index in ipairs(indexes) do
+    for _, text in ipairs(index:match(partial, max + 1)) do
+      if text ~= partial then
+        table.insert(items, setmetatable({ text = text }, mt))
+      end
+    end
+  end
+  local scores = {}
+  for i, item in ipairs(items) do
+    scores[item] = system.fuzzy_match(item.text, partial) * 1e6 - i
+  end
+  table.sort(items, function(a, b) return scores[a] > scores[b] end)
+
+  -- remove duplicates and store
+  local res, seen = {}, {}
+  for _, item in ipairs(items) do
+    local first = seen[item.text]
+    if first then
+      first.info = first.info or item.info
+    elseif #res < max then
+      seen[item.text] = item
+      table.insert(res, item)
     end
   end
+  suggestions = res
 end
 
 
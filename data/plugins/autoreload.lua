@@ -27,15 +27,38 @@ local function reload_doc(doc)
 end
 
 
+local function check_doc(doc)
+  local info = system.get_file_info(doc.filename or "")
+  if info and times[doc] ~= info.modified then
+    reload_doc(doc)
+  end
+end
+
+
+-- reload changed docs as soon as the project's directory monitor reports them
+local on_file_change = core.on_file_change
+
+core.on_file_change = function(type, filename)
+  on_file_change(type, filename)
+  if type == "delete" then return end
+  local abs_filename = system.absolute_path(filename)
+  for _, doc in ipairs(core.docs) do
+    if doc.filename and system.absolute_path(doc.filename) == abs_filename then
+      check_doc(doc)
+    end
+  end
+end
+
+
+-- poll for docs outside of the project or if there is no directory monitor
 core.add_thread(function()
   while true do
-    -- check all doc modified times
+    -- check the modified times of all docs the monitor doesn't cover
     for _, doc in ipairs(core.docs) do
-      local info = system.get_file_info(doc.filename or "")
-      if info and times[doc] ~= info.modified then
-        reload_doc(doc)
+      if not core.is_file_watched(doc.filename or "") then
+        check_doc(doc)
+        coroutine.yield()
       end
-      coroutine.yield()
     end
 
     -- wait for next scan
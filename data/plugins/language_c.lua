@@ -1,3 +1,4 @@
+-- lazy: { files = { "%.c$", "%.h$", "%.inl$", "%.cpp$", "%.hpp$" } }
 local syntax = require "core.syntax"
 
 syntax.add {
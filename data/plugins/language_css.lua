@@ -1,3 +1,4 @@
+-- lazy: { files = { "%.css$" } }
 local syntax = require "core.syntax"
 
 syntax.add {
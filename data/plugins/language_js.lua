@@ -1,3 +1,4 @@
+-- lazy: { files = { "%.js$", "%.json$", "%.cson$" } }
 local syntax = require "core.syntax"
 
 syntax.add {
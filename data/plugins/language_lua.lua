@@ -1,3 +1,4 @@
+-- lazy: { files = "%.lua$", headers = "^#!.*[ /]lua" }
 local syntax = require "core.syntax"
 
 syntax.add {
@@ -1,3 +1,4 @@
+-- lazy: { files = { "%.md$", "%.markdown$" } }
 local syntax = require "core.syntax"
 
 syntax.add {
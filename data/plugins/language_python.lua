@@ -1,3 +1,4 @@
+-- lazy: { files = { "%.py$", "%.pyw$" }, headers = "^#!.*[ /]python" }
 local syntax = require "core.syntax"
 
 syntax.add {
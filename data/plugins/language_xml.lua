@@ -1,3 +1,4 @@
+-- lazy: { files = { "%.xml$", "%.html?$" }, headers = "<%?xml" }
 local syntax = require "core.syntax"
 
 syntax.add {
@@ -1,3 +1,10 @@
+-- lazy: {
+--   commands = { "macro:toggle-record", "macro:play" },
+--   keys = {
+--     ["ctrl+shift+;"] = "macro:toggle-record",
+--     ["ctrl+;"] = "macro:play",
+--   },
+-- }
 local core = require "core"
 local command = require "core.command"
 local keymap = require "core.keymap"
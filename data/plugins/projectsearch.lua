@@ -1,3 +1,10 @@
+-- lazy: {
+--   commands = {
+--     "project-search:find", "project-search:find-pattern",
+--     "project-search:fuzzy-find",
+--   },
+--   keys = { ["ctrl+shift+f"] = "project-search:find" },
+-- }
 local core = require "core"
 local common = require "core.common"
 local keymap = require "core.keymap"
@@ -58,7 +65,7 @@ function ResultsView:begin_search(text, fn)
     self.searching = false
     self.brightness = 100
     core.redraw = true
-  end, self.results)
+  end, self.results, "visible")
 
   self.scroll.to.y = 0
 end
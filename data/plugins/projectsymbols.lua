@@ -0,0 +1,356 @@
+local core = require "core"
+local config = require "core.config"
+local command = require "core.command"
+local keymap = require "core.keymap"
+local syntax = require "core.syntax"
+local autocomplete = require "plugins.autocomplete"
+
+config.project_symbols_save_rate = 10
+
+local cache_version = "1"
+
+-- the indexed files by filename: each keeps the file's modified time, its
+-- distinct symbol names, which are added to the project's symbol index, and
+-- the line each function is defined on (or first used on) as a flat list of
+-- line, name pairs
+local files = {}
+local version = 0
+local dirty = {}
+
+-- the project's symbols are kept in an index of their own, which autocomplete
+-- queries along with the open docs' symbols, so that typing in a doc never
+-- changes it
+local symbol_index
+
+local function get_symbol_index()
+  if symbol_index == nil then
+    local err
+    symbol_index, err = system.symbol_index(config.symbol_pattern)
+    if symbol_index then
+      autocomplete.add_symbol_index(symbol_index)
+    else
+      core.error("Can't index project symbols: %s", err)
+      symbol_index = false
+    end
+  end
+  return symbol_index or nil
+end
+
+-- the definitions of all files, matched by go-to-symbol; each file's are added
+-- to the set as the file is indexed and removed when it changes, and the set
+-- is only rebuilt once most of it is removed entries
+local def_set = system.fuzzy_set({})
+local def_items = {}
+local def_count, def_removed = 0, 0
+
+local function add_defs(filename, file)
+  file.items = {}
+  for i = 1, #file.defs, 2 do
+    local item = {
+      text = file.defs[i + 1], file = filename, line = file.defs[i]
+    }
+    item.id = def_set:add(item.text)
+    def_items[item.id] = item
+    table.insert(file.items, item)
+  end
+  def_count = def_count + #file.items
+end
+
+local function remove_defs(file)
+  for _, item in ipairs(file.items) do
+    def_set:remove(item.id)
+    def_items[item.id] = nil
+  end
+  def_removed = def_removed + #file.items
+end
+
+local function compact_defs()
+  local strs, items = {}, {}
+  for _, file in pairs(files) do
+    for _, item in ipairs(file.items or {}) do
+      table.insert(items, item)
+      item.id = #items
+      strs[item.id] = item.text
+    end
+  end
+  def_set, def_items = system.fuzzy_set(strs), items
+  def_count, def_removed = #items, 0
+end
+
+
+-- files are only matched to a syntax by name, their headers aren't read. The
+-- language plugin for the file is loaded first if it's still deferred
+local function get_syntax(filename)
+  core.trigger_plugins("files", filename)
+  return syntax.get(filename, "")
+end
+
+
+local function is_indexable(filename)
+  return #get_syntax(filename).patterns > 0 and not filename:find("[\t\n]")
+end
+
+
+local function set_file(filename, file)
+  local old = files[filename]
+  if old and old.symbols then
+    old.symbols:splice({}, 1, old.symbols:get_line_count(), 0)
+  end
+  if old and old.items then remove_defs(old) end
+  local symbol_index = get_symbol_index()
+  if file and symbol_index then
+    file.symbols = symbol_index:new_doc()
+    file.symbols:splice({ file.names }, 1, 0, 1)
+  end
+  if file then add_defs(filename, file) end
+  files[filename] = file
+  version = version + 1
+  if def_removed > 1000 and def_removed * 2 > def_count then compact_defs() end
+end
+
+
+-- runs as a job on a worker thread, so it can't use upvalues: indexes each of
+-- `filenames` with the syntax in `syntaxes` given by the same position of
+-- `syntax_ids`, returning a list of the files, false for unreadable ones
+local function index_files(filenames, syntax_ids, syntaxes, symbol_pattern)
+  local tokenizer = require "core.tokenizer"
+
+  local function index_file(fp, syn)
+    local names, seen, defs = {}, {}, {}
+    local state
+    local n = 0
+
+    for line in fp:lines() do
+      n = n + 1
+      local tokens
+      tokens, state = tokenizer.tokenize(syn, line .. "\n", state)
+      local prev_type
+      for _, type, text in tokenizer.each_token(tokens) do
+        if type == "symbol" or type == "function" then
+          for name in text:gmatch(symbol_pattern) do
+            if not seen[name] then
+              seen[name] = true
+              table.insert(names, name)
+            end
+            -- a function following a keyword is most likely its definition
+            local def = defs[name]
+            local is_def = prev_type == "keyword" or prev_type == "keyword2"
+            if type == "function" and (not def or is_def and not def.is_def) then
+              defs[name] = { line = n, is_def = is_def }
+            end
+          end
+        end
+        if not text:find("^%s*$") then prev_type = type end
+      end
+    end
+
+    local file = { names = table.concat(names, " "), defs = {} }
+    for _, name in ipairs(names) do
+      if defs[name] then
+        table.insert(file.defs, defs[name].line)
+        table.insert(file.defs, name)
+      end
+    end
+    return file
+  end
+
+  local res = {}
+  for i, filename in ipairs(filenames) do
+    local fp = io.open(filename, "rb")
+    res[i] = false
+    if fp then
+      res[i] = index_file(fp, syntaxes[syntax_ids[i]])
+      fp:close()
+    end
+  end
+  return res
+end
+
+
+-- starts a job indexing the project file infos in `batch`
+local function start_job(batch)
+  local filenames, syntax_ids, syntaxes, ids = {}, {}, {}, {}
+  for i, info in ipairs(batch) do
+    local syn = get_syntax(info.filename)
+    if not ids[syn] then
+      table.insert(syntaxes, { patterns = syn.patterns, symbols = syn.symbols })
+      ids[syn] = #syntaxes
+    end
+    filenames[i], syntax_ids[i] = info.filename, ids[syn]
+  end
+  return jobs.run(index_files, filenames, syntax_ids, syntaxes,
+    config.symbol_pattern)
+end
+
+
+local function load_cache()
+  local filename, path = core.get_project_cache_filename("symbols")
+  local fp = io.open(filename, "rb")
+  if not fp then return end
+  if fp:read("*l") ~= cache_version .. "\t" .. path then
+    fp:close()
+    return
+  end
+
+  local file
+  local n = 0
+  for line in fp:lines() do
+    local kind, a, b = line:match("^(%a)\t([^\t]*)\t?(.*)$")
+    if kind == "F" then
+      file = { modified = tonumber(a), names = "", defs = {} }
+      files[b] = file
+    elseif kind == "N" and file then
+      file.names = a
+    elseif kind == "D" and file then
+      table.insert(file.defs, tonumber(a))
+      table.insert(file.defs, b)
+    end
+    n = n + 1
+    if n % 1000 == 0 then coroutine.yield() end
+  end
+  fp:close()
+
+  n = 0
+  for name, file in pairs(files) do
+    set_file(name, file)
+    n = n + 1
+    if n % 100 == 0 then coroutine.yield() end
+  end
+end
+
+
+local function save_cache()
+  local filename, path = core.get_project_cache_filename("symbols")
+  system.mkdir(core.cache_dir)
+  local fp = io.open(filename .. ".tmp", "wb")
+  if not fp then
+    core.log_quiet("Can't save symbol cache %q", filename)
+    return
+  end
+  fp:write(cache_version, "\t", path, "\n")
+  for name, file in pairs(files) do
+    fp:write("F\t", file.modified, "\t", name, "\n")
+    fp:write("N\t", file.names, "\n")
+    for i = 1, #file.defs, 2 do
+      fp:write("D\t", file.defs[i], "\t", file.defs[i + 1], "\n")
+    end
+  end
+  fp:close()
+  os.remove(filename)
+  os.rename(filename .. ".tmp", filename)
+end
+
+
+-- brings the index up to date with the project's files, returns true if
+-- anything changed
+local function update_index()
+  local old_version = version
+  local present, stale = {}, {}
+  -- every file changed so far is dealt with by this walk, whether it is still
+  -- indexable, removed or never was; files changed during it are left for the
+  -- next one
+  local changed = dirty
+  dirty = {}
+  for i, info in ipairs(core.project_files) do
+    local name = info.filename
+    if info.type == "file" and is_indexable(name) then
+      present[name] = true
+      local file = files[name]
+      if not file or file.modified ~= info.modified or changed[name] then
+        table.insert(stale, info)
+      end
+    end
+    if i % 1000 == 0 then coroutine.yield() end
+  end
+
+  for name in pairs(files) do
+    if not present[name] then set_file(name, nil) end
+  end
+
+  -- files are tokenized on worker threads in batches, keeping every worker
+  -- busy; the results are applied here as the jobs finish. Without workers
+  -- each job runs as it's started
+  local running = {}
+  local max_running = math.max(jobs.get_worker_count() * 2, 1)
+  local i = 1
+  while i <= #stale or #running > 0 do
+    while i <= #stale and #running < max_running do
+      local batch = { table.unpack(stale, i, math.min(i + 31, #stale)) }
+      table.insert(running, { job = start_job(batch), batch = batch })
+      i = i + #batch
+    end
+    coroutine.yield(0.01)
+    for j = #running, 1, -1 do
+      local job, batch = running[j].job, running[j].batch
+      local status = job:status()
+      if status ~= "pending" and status ~= "running" then
+        local res, err = job:result()
+        for k, info in ipairs(batch) do
+          local file = res and res[k] or nil
+          if file then file.modified = info.modified end
+          set_file(info.filename, file)
+        end
+        if not res then core.log_quiet("Can't index symbols: %s", err) end
+        table.remove(running, j)
+      end
+    end
+  end
+  return version ~= old_version
+end
+
+
+local on_file_change = core.on_file_change
+
+core.on_file_change = function(type, filename)
+  on_file_change(type, filename)
+  dirty[filename] = true
+end
+
+
+core.add_thread(function()
+  load_cache()
+  local last_files, unsaved, last_save = nil, false, 0
+
+  while true do
+    if core.project_files ~= last_files or next(dirty) then
+      last_files = core.project_files
+      unsaved = update_index() or unsaved
+    end
+    local save_due = system.get_time() - last_save
+      > config.project_symbols_save_rate
+    if unsaved and save_due then
+      save_cache()
+      unsaved, last_save = false, system.get_time()
+    end
+    coroutine.yield(1)
+  end
+end, nil, "idle")
+
+
+command.add(nil, {
+  ["project-symbols:go-to-symbol"] = function()
+    core.command_view:enter("Go To Symbol", function(text, item)
+      if not item then return end
+      local dv = core.root_view:open_doc(core.open_doc(item.file))
+      dv.doc:set_selection(item.line, 1)
+      dv:scroll_to_line(item.line, true)
+    end, function(text, max)
+      local res = {}
+      for i, idx in ipairs(def_set:match(text, max)) do
+        local item = def_items[idx]
+        res[i] = {
+          text = item.text,
+          info = item.file .. ":" .. item.line,
+          file = item.file,
+          line = item.line,
+        }
+      end
+      return res
+    end)
+  end,
+})
+
+
+keymap.add {
+  ["ctrl+t"] = "project-symbols:go-to-symbol",
+}
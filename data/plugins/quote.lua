@@ -1,3 +1,4 @@
+-- lazy: { commands = "quote:quote", keys = { ["ctrl+'"] = "quote:quote" } }
 local core = require "core"
 local command = require "core.command"
 local keymap = require "core.keymap"
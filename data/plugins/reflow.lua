@@ -1,3 +1,7 @@
+-- lazy: {
+--   commands = "reflow:reflow",
+--   keys = { ["ctrl+shift+q"] = "reflow:reflow" },
+-- }
 local core = require "core"
 local config = require "core.config"
 local command = require "core.command"
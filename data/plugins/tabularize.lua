@@ -1,3 +1,4 @@
+-- lazy: { commands = "tabularize:tabularize" }
 local core = require "core"
 local command = require "core.command"
 local translate = require "core.doc.translate"
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+
+/* the allocator given to Lua states: small blocks come from size-class pools,
+** each a free list of blocks carved from 64KB slabs, anything larger comes
+** from the system allocator. Every state gets its own pools so they need no
+** locking, as a state is only ever used by one thread at a time. Lua passes
+** the size of each block it frees or resizes, so blocks need no header.
+** Slabs are kept for reuse until the state is closed */
+
+#define GRANULE    16
+#define CLASSES    16
+#define SMALL_MAX  (GRANULE * CLASSES)
+#define SLAB_SIZE  (64 * 1024)
+
+typedef struct Block { struct Block *next; } Block;
+
+/* the header of a slab, padded so the blocks after it stay aligned */
+typedef union Slab { union Slab *next; char align[GRANULE]; } Slab;
+
+typedef struct {
+  Block *free[CLASSES];
+  char *bump[CLASSES];
+  size_t bump_left[CLASSES];
+  Slab *slabs;
+  AllocStats stats;
+} Pool;
+
+const char *alloc_kind_names[ALLOC_KINDS] = {
+  "string", "table", "function", "userdata", "thread", "proto", "upvalue",
+  "other"
+};
+
+
+static int size_class(size_t size) {
+  return (size - 1) / GRANULE;
+}
+
+
+static void* alloc_block(Pool *pool, size_t size) {
+  if (size > SMALL_MAX) {
+    void *p = malloc(size);
+    if (p) { pool->stats.large += size; }
+    return p;
+  }
+
+  int cls = size_class(size);
+  size = (cls + 1) * GRANULE;
+  Block *b = pool->free[cls];
+  if (b) {
+    pool->free[cls] = b->next;
+  } else {
+    if (pool->bump_left[cls] < size) {
+      Slab *slab = malloc(SLAB_SIZE);
+      if (!slab) { return NULL; }
+      slab->next = pool->slabs;
+      pool->slabs = slab;
+      pool->bump[cls] = (char*) (slab + 1);
+      pool->bump_left[cls] = SLAB_SIZE - sizeof(Slab);
+      pool->stats.pooled += SLAB_SIZE;
+    }
+    b = (Block*) pool->bump[cls];
+    pool->bump[cls] += size;
+    pool->bump_left[cls] -= size;
+  }
+  pool->stats.small += size;
+  return b;
+}
+
+
+static void free_block(Pool *pool, void *ptr, size_t size) {
+  if (size > SMALL_MAX) {
+    free(ptr);
+    pool->stats.large -= size;
+    return;
+  }
+  int cls = size_class(size);
+  Block *b = ptr;
+  b->next = pool->free[cls];
+  pool->free[cls] = b;
+  pool->stats.small -= (cls + 1) * GRANULE;
+}
+
+
+static void* lua_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+  Pool *pool = ud;
+
+  /* with no block, `osize` is the type of object being created */
+  if (!ptr) {
+    int kind = osize - LUA_TSTRING;
+    if (kind < 0 || kind > ALLOC_OTHER) { kind = ALLOC_OTHER; }
+    pool->stats.counts[kind]++;
+    pool->stats.bytes[kind] += nsize;
+    osize = 0;
+  }
+
+  if (nsize == 0) {
+    if (ptr) { free_block(pool, ptr, osize); }
+    return NULL;
+  }
+
+  if (ptr && osize <= SMALL_MAX && nsize <= SMALL_MAX
+    && size_class(osize) == size_class(nsize)
+  ) {
+    return ptr;
+  }
+
+  if (ptr && osize > SMALL_MAX && nsize > SMALL_MAX) {
+    void *p = realloc(ptr, nsize);
+    if (p) { pool->stats.large += nsize - osize; }
+    return p;
+  }
+
+  void *p = alloc_block(pool, nsize);
+  if (!p) {
+    /* Lua expects shrinking to never fail, so keep the old block -- when it is
+    ** later freed as a small block it is simply reused as one */
+    return nsize <= osize ? ptr : NULL;
+  }
+  if (ptr) {
+    memcpy(p, ptr, osize < nsize ? osize : nsize);
+    free_block(pool, ptr, osize);
+  }
+  return p;
+}
+
+
+static int panic(lua_State *L) {
+  fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n",
+    lua_tostring(L, -1));
+  return 0;
+}
+
+
+lua_State* alloc_newstate(void) {
+  Pool *pool = calloc(1, sizeof(Pool));
+  if (!pool) { return NULL; }
+  lua_State *L = lua_newstate(lua_alloc, pool);
+  if (!L) {
+    free(pool);
+    return NULL;
+  }
+  lua_atpanic(L, panic);
+  return L;
+}
+
+
+void alloc_close(lua_State *L) {
+  void *ud;
+  lua_getallocf(L, &ud);
+  lua_close(L);
+  Pool *pool = ud;
+  while (pool->slabs) {
+    Slab *slab = pool->slabs;
+    pool->slabs = slab->next;
+    free(slab);
+  }
+  free(pool);
+}
+
+
+void alloc_get_stats(lua_State *L, AllocStats *stats) {
+  void *ud;
+  if (lua_getallocf(L, &ud) == lua_alloc) {
+    *stats = ((Pool*) ud)->stats;
+  } else {
+    memset(stats, 0, sizeof(*stats));
+  }
+}
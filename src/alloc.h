@@ -0,0 +1,27 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+#include "lib/lua52/lua.h"
+
+/* kinds of allocations counted, by the type of object Lua is creating */
+enum {
+  ALLOC_STRING, ALLOC_TABLE, ALLOC_FUNCTION, ALLOC_USERDATA, ALLOC_THREAD,
+  ALLOC_PROTO, ALLOC_UPVALUE, ALLOC_OTHER, ALLOC_KINDS
+};
+
+typedef struct {
+  size_t small;   /* bytes of small blocks in use */
+  size_t large;   /* bytes of large blocks in use */
+  size_t pooled;  /* bytes of slabs reserved for small blocks */
+  size_t counts[ALLOC_KINDS];
+  size_t bytes[ALLOC_KINDS];
+} AllocStats;
+
+extern const char *alloc_kind_names[ALLOC_KINDS];
+
+lua_State* alloc_newstate(void);
+void alloc_close(lua_State *L);
+void alloc_get_stats(lua_State *L, AllocStats *stats);
+
+#endif
@@ -3,11 +3,15 @@
 
 int luaopen_system(lua_State *L);
 int luaopen_renderer(lua_State *L);
+int luaopen_dirmonitor(lua_State *L);
+int luaopen_jobs(lua_State *L);
 
 
 static const luaL_Reg libs[] = {
-  { "system",    luaopen_system     },
-  { "renderer",  luaopen_renderer   },
+  { "system",     luaopen_system     },
+  { "renderer",   luaopen_renderer   },
+  { "dirmonitor", luaopen_dirmonitor },
+  { "jobs",       luaopen_jobs       },
   { NULL, NULL }
 };
 
@@ -6,7 +6,14 @@
 #include "lib/lua52/lualib.h"
 
 #define API_TYPE_FONT "Font"
+#define API_TYPE_DIRMONITOR "DirMonitor"
+#define API_TYPE_TREESCAN "TreeScan"
+#define API_TYPE_FUZZYSET "FuzzySet"
+#define API_TYPE_SYMBOLINDEX "SymbolIndex"
+#define API_TYPE_SYMBOLDOC "SymbolDoc"
+#define API_TYPE_JOB "Job"
 
 void api_load_libs(lua_State *L);
+int dirmonitor_get_fd(lua_State *L, int idx);
 
 #endif
@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "api.h"
+#ifdef __linux__
+  #include <unistd.h>
+  #include <sys/inotify.h>
+#endif
+
+/* watches directories for changes to their entries -- `dirmonitor.new()`
+** returns nil on platforms without inotify so the caller can fall back to
+** polling. Events are read without blocking and returned as a table of
+** `{ type, dir, name, is_dir }` where type is "create", "delete", "modify" or
+** "overflow"; on "overflow" events were dropped and the caller should rescan */
+
+typedef struct {
+  int wd;
+  char *path;
+} Watch;
+
+typedef struct {
+  int fd;
+  Watch *watches;
+  int count, capacity;
+} DirMonitor;
+
+
+#ifdef __linux__
+
+#define WATCH_MASK \
+  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | \
+   IN_ONLYDIR)
+
+
+static Watch* find_watch(DirMonitor *self, int wd) {
+  for (int i = 0; i < self->count; i++) {
+    if (self->watches[i].wd == wd) { return &self->watches[i]; }
+  }
+  return NULL;
+}
+
+
+static void remove_watch(DirMonitor *self, Watch *w) {
+  free(w->path);
+  *w = self->watches[--self->count];
+}
+
+
+static int f_new(lua_State *L) {
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    lua_pushnil(L);
+    lua_pushstring(L, strerror(errno));
+    return 2;
+  }
+  DirMonitor *self = lua_newuserdata(L, sizeof(*self));
+  memset(self, 0, sizeof(*self));
+  self->fd = fd;
+  luaL_setmetatable(L, API_TYPE_DIRMONITOR);
+  return 1;
+}
+
+
+static int f_watch(lua_State *L) {
+  DirMonitor *self = luaL_checkudata(L, 1, API_TYPE_DIRMONITOR);
+  const char *path = luaL_checkstring(L, 2);
+
+  int wd = inotify_add_watch(self->fd, path, WATCH_MASK);
+  if (wd < 0) {
+    lua_pushnil(L);
+    lua_pushstring(L, strerror(errno));
+    return 2;
+  }
+
+  /* the same directory may be re-added under another path; keep the newest */
+  Watch *w = find_watch(self, wd);
+  if (w) {
+    free(w->path);
+  } else {
+    if (self->count == self->capacity) {
+      int n = self->capacity ? self->capacity * 2 : 64;
+      Watch *p = realloc(self->watches, n * sizeof(*p));
+      if (!p) { luaL_error(L, "buffer allocation failed"); }
+      self->watches = p;
+      self->capacity = n;
+    }
+    w = &self->watches[self->count++];
+    w->wd = wd;
+  }
+  w->path = strdup(path);
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
+static int f_unwatch(lua_State *L) {
+  DirMonitor *self = luaL_checkudata(L, 1, API_TYPE_DIRMONITOR);
+  const char *path = luaL_checkstring(L, 2);
+  for (int i = 0; i < self->count; i++) {
+    Watch *w = &self->watches[i];
+    if (strcmp(w->path, path) == 0) {
+      inotify_rm_watch(self->fd, w->wd);
+      remove_watch(self, w);
+      break;
+    }
+  }
+  return 0;
+}
+
+
+static void push_event(lua_State *L, int *n, const char *type,
+  const char *dir, const char *name, int is_dir
+) {
+  lua_createtable(L, 0, 4);
+  lua_pushstring(L, type);
+  lua_setfield(L, -2, "type");
+  if (dir) {
+    lua_pushstring(L, dir);
+    lua_setfield(L, -2, "dir");
+    lua_pushstring(L, name);
+    lua_setfield(L, -2, "name");
+    lua_pushboolean(L, is_dir);
+    lua_setfield(L, -2, "is_dir");
+  }
+  lua_rawseti(L, -2, (*n)++);
+}
+
+
+static int f_read(lua_State *L) {
+  DirMonitor *self = luaL_checkudata(L, 1, API_TYPE_DIRMONITOR);
+  char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  int n = 1;
+
+  lua_newtable(L);
+  for (;;) {
+    ssize_t len = read(self->fd, buf, sizeof(buf));
+    if (len <= 0) { break; }
+
+    for (char *p = buf; p < buf + len; ) {
+      struct inotify_event *e = (struct inotify_event*) p;
+      p += sizeof(struct inotify_event) + e->len;
+
+      if (e->mask & IN_Q_OVERFLOW) {
+        push_event(L, &n, "overflow", NULL, NULL, 0);
+        continue;
+      }
+      Watch *w = find_watch(self, e->wd);
+      if (!w) { continue; }
+      if (e->mask & IN_IGNORED) {
+        remove_watch(self, w);
+        continue;
+      }
+      if (e->len == 0) { continue; }
+
+      int is_dir = !!(e->mask & IN_ISDIR);
+      if (e->mask & (IN_CREATE | IN_MOVED_TO)) {
+        push_event(L, &n, "create", w->path, e->name, is_dir);
+      } else if (e->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        push_event(L, &n, "delete", w->path, e->name, is_dir);
+      } else if (e->mask & IN_CLOSE_WRITE) {
+        push_event(L, &n, "modify", w->path, e->name, is_dir);
+      }
+    }
+  }
+  return 1;
+}
+
+
+/* returns the inotify descriptor of the monitor at `idx`, for the native
+** tree scan to add its watches to */
+int dirmonitor_get_fd(lua_State *L, int idx) {
+  DirMonitor *self = luaL_checkudata(L, idx, API_TYPE_DIRMONITOR);
+  return self->fd;
+}
+
+
+static int f_gc(lua_State *L) {
+  DirMonitor *self = luaL_checkudata(L, 1, API_TYPE_DIRMONITOR);
+  for (int i = 0; i < self->count; i++) {
+    free(self->watches[i].path);
+  }
+  free(self->watches);
+  close(self->fd);
+  return 0;
+}
+
+#else
+
+static int f_new(lua_State *L) {
+  lua_pushnil(L);
+  lua_pushstring(L, "directory monitoring is not supported on this platform");
+  return 2;
+}
+
+int dirmonitor_get_fd(lua_State *L, int idx) { return -1; }
+
+static int f_watch(lua_State *L) { return 0; }
+static int f_unwatch(lua_State *L) { return 0; }
+static int f_read(lua_State *L) { lua_newtable(L); return 1; }
+static int f_gc(lua_State *L) { return 0; }
+
+#endif
+
+
+static const luaL_Reg lib[] = {
+  { "new",     f_new     },
+  { NULL, NULL }
+};
+
+static const luaL_Reg meta[] = {
+  { "__gc",    f_gc      },
+  { "watch",   f_watch   },
+  { "unwatch", f_unwatch },
+  { "read",    f_read    },
+  { NULL, NULL }
+};
+
+
+int luaopen_dirmonitor(lua_State *L) {
+  luaL_newmetatable(L, API_TYPE_DIRMONITOR);
+  luaL_setfuncs(L, meta, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+  luaL_newlib(L, lib);
+  return 1;
+}
@@ -0,0 +1,536 @@
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "api.h"
+#include "alloc.h"
+
+/* runs lua code on a pool of worker threads -- `jobs.run(fn, ...)` runs `fn`,
+** a string of lua code or a function with no upvalues other than _ENV, in a
+** new lua_State with the standard libraries and the caller's `package.path`.
+** Arguments and results are copied between the states and may be nil,
+** booleans, numbers, strings or tables of these. A running job can call
+** `post(value)` to pass values back, which the main thread gets from
+** `job:read()`, and is stopped by `job:cancel()` the next time its hook runs.
+** The main loop is woken whenever a job posts a value or finishes */
+
+#define MAX_WORKERS 8
+#define MAX_DEPTH 64
+#define HOOK_COUNT 1000
+
+typedef struct {
+  char *data;
+  size_t len, cap;
+} Buffer;
+
+typedef struct Message {
+  struct Message *next;
+  Buffer buf;
+} Message;
+
+enum { JOB_PENDING, JOB_RUNNING, JOB_DONE, JOB_ERROR, JOB_CANCELLED };
+
+static const char *status_names[] = {
+  "pending", "running", "done", "error", "cancelled"
+};
+
+typedef struct Job {
+  struct Job *next;
+  Buffer code;
+  char *path;
+  Buffer args;
+  Buffer result;
+  Message *messages, *last_message;
+  int status;
+  int refs;
+  SDL_atomic_t cancelled;
+} Job;
+
+static SDL_mutex *mutex;
+static SDL_cond *cond;
+static Job *queue, *queue_tail;
+static int worker_count = -1;
+static char job_key;
+
+
+static bool buffer_add(Buffer *b, const void *p, size_t n) {
+  if (b->len + n > b->cap) {
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + n) { cap *= 2; }
+    char *data = realloc(b->data, cap);
+    if (!data) { return false; }
+    b->data = data;
+    b->cap = cap;
+  }
+  memcpy(b->data + b->len, p, n);
+  b->len += n;
+  return true;
+}
+
+
+static bool buffer_add_tag(Buffer *b, char tag) {
+  return buffer_add(b, &tag, 1);
+}
+
+
+/* appends the value at `idx` to the buffer, returns an error message if it
+** can't be copied */
+static const char* serialize(lua_State *L, int idx, Buffer *b, int depth) {
+  idx = lua_absindex(L, idx);
+  switch (lua_type(L, idx)) {
+    case LUA_TNIL:
+      return buffer_add_tag(b, 'n') ? NULL : "out of memory";
+
+    case LUA_TBOOLEAN:
+      return buffer_add_tag(b, lua_toboolean(L, idx) ? 't' : 'f')
+        ? NULL : "out of memory";
+
+    case LUA_TNUMBER: {
+      double n = lua_tonumber(L, idx);
+      bool ok = buffer_add_tag(b, 'd') && buffer_add(b, &n, sizeof(n));
+      return ok ? NULL : "out of memory";
+    }
+
+    case LUA_TSTRING: {
+      size_t len;
+      const char *s = lua_tolstring(L, idx, &len);
+      uint32_t n = len;
+      bool ok = buffer_add_tag(b, 's') && buffer_add(b, &n, sizeof(n))
+        && buffer_add(b, s, len);
+      return ok ? NULL : "out of memory";
+    }
+
+    case LUA_TTABLE: {
+      if (depth >= MAX_DEPTH) { return "tables are nested too deeply"; }
+      if (!lua_checkstack(L, 3)) { return "stack overflow"; }
+      if (!buffer_add_tag(b, '{')) { return "out of memory"; }
+      lua_pushnil(L);
+      while (lua_next(L, idx)) {
+        const char *err = serialize(L, -2, b, depth + 1);
+        if (!err) { err = serialize(L, -1, b, depth + 1); }
+        lua_pop(L, 1);
+        if (err) {
+          lua_pop(L, 1);
+          return err;
+        }
+      }
+      return buffer_add_tag(b, '}') ? NULL : "out of memory";
+    }
+  }
+  return "only nil, booleans, numbers, strings and tables can be copied";
+}
+
+
+static const char* serialize_values(lua_State *L, int first, int count,
+  Buffer *b)
+{
+  uint32_t n = count;
+  if (!buffer_add(b, &n, sizeof(n))) { return "out of memory"; }
+  for (int i = 0; i < count; i++) {
+    const char *err = serialize(L, first + i, b, 0);
+    if (err) { return err; }
+  }
+  return NULL;
+}
+
+
+static const char* deserialize(lua_State *L, const char *p) {
+  luaL_checkstack(L, 3, NULL);
+  switch (*p++) {
+    case 'n': lua_pushnil(L); return p;
+    case 't': lua_pushboolean(L, 1); return p;
+    case 'f': lua_pushboolean(L, 0); return p;
+
+    case 'd': {
+      double n;
+      memcpy(&n, p, sizeof(n));
+      lua_pushnumber(L, n);
+      return p + sizeof(n);
+    }
+
+    case 's': {
+      uint32_t len;
+      memcpy(&len, p, sizeof(len));
+      p += sizeof(len);
+      lua_pushlstring(L, p, len);
+      return p + len;
+    }
+
+    case '{':
+      lua_newtable(L);
+      while (*p != '}') {
+        p = deserialize(L, p);
+        p = deserialize(L, p);
+        lua_rawset(L, -3);
+      }
+      return p + 1;
+  }
+  return p;
+}
+
+
+static int deserialize_values(lua_State *L, const Buffer *b) {
+  uint32_t n;
+  memcpy(&n, b->data, sizeof(n));
+  const char *p = b->data + sizeof(n);
+  for (uint32_t i = 0; i < n; i++) { p = deserialize(L, p); }
+  return n;
+}
+
+
+static void free_job(Job *job) {
+  Message *m = job->messages;
+  while (m) {
+    Message *next = m->next;
+    free(m->buf.data);
+    free(m);
+    m = next;
+  }
+  free(job->code.data);
+  free(job->path);
+  free(job->args.data);
+  free(job->result.data);
+  free(job);
+}
+
+
+/* must be called with the mutex locked */
+static void release_job(Job *job) {
+  if (--job->refs == 0) { free_job(job); }
+}
+
+
+static void wake_main_loop(void) {
+  SDL_Event e;
+  memset(&e, 0, sizeof(e));
+  e.type = SDL_USEREVENT;
+  SDL_PushEvent(&e);
+}
+
+
+static void hook(lua_State *L, lua_Debug *ar) {
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &job_key);
+  Job *job = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if (SDL_AtomicGet(&job->cancelled)) { luaL_error(L, "job cancelled"); }
+}
+
+
+static int f_post(lua_State *L) {
+  Job *job = lua_touserdata(L, lua_upvalueindex(1));
+  Message *m = calloc(1, sizeof(*m));
+  if (!m) { luaL_error(L, "out of memory"); }
+  lua_settop(L, 1);
+  const char *err = serialize_values(L, 1, 1, &m->buf);
+  if (err) {
+    free(m->buf.data);
+    free(m);
+    luaL_error(L, "%s", err);
+  }
+
+  SDL_LockMutex(mutex);
+  if (job->last_message) {
+    job->last_message->next = m;
+  } else {
+    job->messages = m;
+  }
+  job->last_message = m;
+  SDL_UnlockMutex(mutex);
+  wake_main_loop();
+  return 0;
+}
+
+
+static int job_main(lua_State *L) {
+  Job *job = lua_touserdata(L, 1);
+  lua_settop(L, 0);
+  if (luaL_loadbuffer(L, job->code.data, job->code.len, "=job") != LUA_OK) {
+    lua_error(L);
+  }
+  int n = deserialize_values(L, &job->args);
+  lua_call(L, n, LUA_MULTRET);
+
+  const char *err = serialize_values(L, 1, lua_gettop(L), &job->result);
+  if (err) { luaL_error(L, "can't return results: %s", err); }
+  return 0;
+}
+
+
+static void run_job(Job *job) {
+  const char *err = "can't create lua state";
+  lua_State *L = alloc_newstate();
+  if (L) {
+    luaL_openlibs(L);
+    lua_getglobal(L, "package");
+    lua_pushstring(L, job->path);
+    lua_setfield(L, -2, "path");
+    lua_pop(L, 1);
+    lua_pushlightuserdata(L, job);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &job_key);
+    lua_pushlightuserdata(L, job);
+    lua_pushcclosure(L, f_post, 1);
+    lua_setglobal(L, "post");
+    lua_sethook(L, hook, LUA_MASKCOUNT, HOOK_COUNT);
+
+    lua_pushcfunction(L, job_main);
+    lua_pushlightuserdata(L, job);
+    err = NULL;
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+      err = lua_tostring(L, -1);
+      if (!err) { err = "job failed"; }
+    }
+  }
+
+  /* on failure the result holds the error message instead */
+  if (err) {
+    job->result.len = 0;
+    if (!buffer_add(&job->result, err, strlen(err) + 1)) {
+      free(job->result.data);
+      job->result.data = NULL;
+    }
+  }
+  SDL_LockMutex(mutex);
+  if (!err) {
+    job->status = JOB_DONE;
+  } else {
+    job->status = SDL_AtomicGet(&job->cancelled) ? JOB_CANCELLED : JOB_ERROR;
+  }
+  SDL_UnlockMutex(mutex);
+  if (L) { alloc_close(L); }
+  wake_main_loop();
+}
+
+
+static int worker_main(void *udata) {
+  SDL_LockMutex(mutex);
+  for (;;) {
+    while (!queue) { SDL_CondWait(cond, mutex); }
+    Job *job = queue;
+    queue = job->next;
+    if (!queue) { queue_tail = NULL; }
+    job->status = JOB_RUNNING;
+    SDL_UnlockMutex(mutex);
+
+    run_job(job);
+
+    SDL_LockMutex(mutex);
+    release_job(job);
+  }
+  return 0;
+}
+
+
+static void init_workers(void) {
+  worker_count = 0;
+  mutex = SDL_CreateMutex();
+  cond = SDL_CreateCond();
+  if (!mutex || !cond) { return; }
+
+  int n = SDL_GetCPUCount() - 1;
+  if (n < 1) { n = 1; }
+  if (n > MAX_WORKERS) { n = MAX_WORKERS; }
+  for (int i = 0; i < n; i++) {
+    SDL_Thread *thread = SDL_CreateThread(worker_main, "jobs", NULL);
+    if (!thread) { break; }
+    SDL_DetachThread(thread);
+    worker_count++;
+  }
+}
+
+
+static int writer(lua_State *L, const void *p, size_t sz, void *ud) {
+  return !buffer_add(ud, p, sz);
+}
+
+
+static int f_run(lua_State *L) {
+  if (worker_count < 0) { init_workers(); }
+  if (!mutex) { luaL_error(L, "can't create job mutex"); }
+
+  Job *job = calloc(1, sizeof(*job));
+  if (!job) { luaL_error(L, "out of memory"); }
+  const char *err = NULL;
+
+  if (lua_type(L, 1) == LUA_TFUNCTION) {
+    /* the function is copied as bytecode; when loaded its first upvalue is
+    ** set to the new state's globals, so only _ENV can be an upvalue */
+    const char *first = lua_getupvalue(L, 1, 1);
+    if (first) { lua_pop(L, 1); }
+    const char *second = lua_getupvalue(L, 1, 2);
+    if (second) { lua_pop(L, 1); }
+    if (lua_iscfunction(L, 1)) {
+      err = "can't run a C function as a job";
+    } else if (second || (first && strcmp(first, "_ENV"))) {
+      err = "job functions can't have upvalues";
+    } else {
+      lua_pushvalue(L, 1);
+      if (lua_dump(L, writer, &job->code) != 0) { err = "out of memory"; }
+      lua_pop(L, 1);
+    }
+  } else {
+    size_t len;
+    const char *code = luaL_checklstring(L, 1, &len);
+    if (!buffer_add(&job->code, code, len)) { err = "out of memory"; }
+  }
+
+  lua_getglobal(L, "package");
+  lua_getfield(L, -1, "path");
+  const char *path = lua_tostring(L, -1);
+  job->path = strdup(path ? path : "");
+  lua_pop(L, 2);
+  if (!err && !job->path) { err = "out of memory"; }
+
+  if (!err) { err = serialize_values(L, 2, lua_gettop(L) - 1, &job->args); }
+  if (err) {
+    free_job(job);
+    luaL_error(L, "%s", err);
+  }
+
+  Job **self = lua_newuserdata(L, sizeof(*self));
+  *self = job;
+  luaL_setmetatable(L, API_TYPE_JOB);
+
+  /* without workers the job is run right away, on this thread */
+  if (worker_count == 0) {
+    job->refs = 1;
+    job->status = JOB_RUNNING;
+    run_job(job);
+    return 1;
+  }
+
+  SDL_LockMutex(mutex);
+  job->refs = 2;
+  if (queue_tail) {
+    queue_tail->next = job;
+  } else {
+    queue = job;
+  }
+  queue_tail = job;
+  SDL_CondSignal(cond);
+  SDL_UnlockMutex(mutex);
+  return 1;
+}
+
+
+static int f_get_worker_count(lua_State *L) {
+  if (worker_count < 0) { init_workers(); }
+  lua_pushnumber(L, worker_count);
+  return 1;
+}
+
+
+static int f_status(lua_State *L) {
+  Job **self = luaL_checkudata(L, 1, API_TYPE_JOB);
+  SDL_LockMutex(mutex);
+  int status = (*self)->status;
+  SDL_UnlockMutex(mutex);
+  lua_pushstring(L, status_names[status]);
+  return 1;
+}
+
+
+static int f_result(lua_State *L) {
+  Job **self = luaL_checkudata(L, 1, API_TYPE_JOB);
+  Job *job = *self;
+  SDL_LockMutex(mutex);
+  int status = job->status;
+  SDL_UnlockMutex(mutex);
+
+  if (status == JOB_DONE) {
+    return deserialize_values(L, &job->result);
+  }
+  lua_pushnil(L);
+  if (status == JOB_PENDING || status == JOB_RUNNING) {
+    lua_pushstring(L, "job is not finished");
+  } else {
+    lua_pushstring(L, job->result.data ? job->result.data : "out of memory");
+  }
+  return 2;
+}
+
+
+static int f_read(lua_State *L) {
+  Job **self = luaL_checkudata(L, 1, API_TYPE_JOB);
+  Job *job = *self;
+  SDL_LockMutex(mutex);
+  Message *m = job->messages;
+  job->messages = job->last_message = NULL;
+  SDL_UnlockMutex(mutex);
+
+  lua_newtable(L);
+  for (int i = 1; m; i++) {
+    Message *next = m->next;
+    deserialize_values(L, &m->buf);
+    lua_rawseti(L, -2, i);
+    free(m->buf.data);
+    free(m);
+    m = next;
+  }
+  return 1;
+}
+
+
+static void cancel(Job *job) {
+  SDL_AtomicSet(&job->cancelled, 1);
+  SDL_LockMutex(mutex);
+  if (job->status == JOB_PENDING) {
+    /* not picked up by a worker yet: take it off the queue */
+    Job **p = &queue;
+    while (*p && *p != job) { p = &(*p)->next; }
+    if (*p) {
+      *p = job->next;
+      if (queue_tail == job) {
+        queue_tail = NULL;
+        for (Job *j = queue; j; j = j->next) { queue_tail = j; }
+      }
+      job->status = JOB_CANCELLED;
+      release_job(job);
+    }
+  }
+  SDL_UnlockMutex(mutex);
+}
+
+
+static int f_cancel(lua_State *L) {
+  Job **self = luaL_checkudata(L, 1, API_TYPE_JOB);
+  cancel(*self);
+  return 0;
+}
+
+
+static int f_gc(lua_State *L) {
+  Job **self = luaL_checkudata(L, 1, API_TYPE_JOB);
+  cancel(*self);
+  SDL_LockMutex(mutex);
+  release_job(*self);
+  SDL_UnlockMutex(mutex);
+  return 0;
+}
+
+
+static const luaL_Reg lib[] = {
+  { "run",              f_run              },
+  { "get_worker_count", f_get_worker_count },
+  { NULL, NULL }
+};
+
+static const luaL_Reg meta[] = {
+  { "__gc",             f_gc               },
+  { "status",           f_status           },
+  { "result",           f_result           },
+  { "read",             f_read             },
+  { "cancel",           f_cancel           },
+  { NULL, NULL }
+};
+
+
+int luaopen_jobs(lua_State *L) {
+  luaL_newmetatable(L, API_TYPE_JOB);
+  luaL_setfuncs(L, meta, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+  luaL_newlib(L, lib);
+  return 1;
+}
@@ -1,6 +1,9 @@
+#include <errno.h>
+#include <string.h>
 #include "api.h"
 #include "renderer.h"
 #include "rencache.h"
+#include "latency.h"
 
 
 static RenColor checkcolor(lua_State *L, int idx, int def) {
@@ -45,10 +48,60 @@ static int f_begin_frame(lua_State *L) {
 
 static int f_end_frame(lua_State *L) {
   rencache_end_frame();
+  latency_present();
   return 0;
 }
 
 
+static int f_get_stats(lua_State *L) {
+  RenCacheStats stats;
+  rencache_get_stats(&stats);
+  lua_newtable(L);
+  lua_pushnumber(L, stats.hash_time);
+  lua_setfield(L, -2, "hash_time");
+  lua_pushnumber(L, stats.draw_time);
+  lua_setfield(L, -2, "draw_time");
+  lua_pushnumber(L, stats.present_time);
+  lua_setfield(L, -2, "present_time");
+  lua_pushnumber(L, stats.commands);
+  lua_setfield(L, -2, "commands");
+  lua_pushnumber(L, stats.rects);
+  lua_setfield(L, -2, "rects");
+  return 1;
+}
+
+
+static int f_save_frame(lua_State *L) {
+  const char *filename = luaL_checkstring(L, 1);
+  if (ren_save_frame(filename) != 0) {
+    lua_pushnil(L);
+    lua_pushstring(L, strerror(errno));
+    return 2;
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
+static int f_set_glyph_cache(lua_State *L) {
+  ren_set_glyph_cache(luaL_optstring(L, 1, NULL));
+  return 0;
+}
+
+
+static int f_compare_frame(lua_State *L) {
+  const char *filename = luaL_checkstring(L, 1);
+  int diff = ren_compare_frame(filename);
+  if (diff < 0) {
+    lua_pushnil(L);
+    lua_pushstring(L, diff == -1 ? strerror(errno) : "image size differs");
+    return 2;
+  }
+  lua_pushnumber(L, diff);
+  return 1;
+}
+
+
 static int f_set_clip_rect(lua_State *L) {
   RenRect rect;
   rect.x = luaL_checknumber(L, 1);
@@ -85,14 +138,18 @@ static int f_draw_text(lua_State *L) {
 
 
 static const luaL_Reg lib[] = {
-  { "show_debug",    f_show_debug    },
-  { "get_size",      f_get_size      },
-  { "begin_frame",   f_begin_frame   },
-  { "end_frame",     f_end_frame     },
-  { "set_clip_rect", f_set_clip_rect },
-  { "draw_rect",     f_draw_rect     },
-  { "draw_text",     f_draw_text     },
-  { NULL,            NULL            }
+  { "show_debug",      f_show_debug      },
+  { "get_size",        f_get_size        },
+  { "begin_frame",     f_begin_frame     },
+  { "end_frame",       f_end_frame       },
+  { "get_stats",       f_get_stats       },
+  { "save_frame",      f_save_frame      },
+  { "compare_frame",   f_compare_frame   },
+  { "set_glyph_cache", f_set_glyph_cache },
+  { "set_clip_rect",   f_set_clip_rect   },
+  { "draw_rect",       f_draw_rect       },
+  { "draw_text",       f_draw_text       },
+  { NULL,              NULL              }
 };
 
 
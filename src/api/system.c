@@ -4,11 +4,23 @@
 #include <dirent.h>
 #include <unistd.h>
 #include <errno.h>
+#include <math.h>
 #include <sys/stat.h>
 #include "api.h"
 #include "rencache.h"
+#include "parallel.h"
+#include "scan.h"
+#include "pattern.h"
+#include "ignore.h"
+#include "fuzzy.h"
+#include "symbols.h"
+#include "latency.h"
+#include "trace.h"
+#include "alloc.h"
 #ifdef _WIN32
   #include <windows.h>
+#else
+  #include <sys/resource.h>
 #endif
 
 extern SDL_Window *window;
@@ -80,6 +92,7 @@ top:
       return 4;
 
     case SDL_KEYDOWN:
+      latency_input(LATENCY_KEY, e.key.timestamp);
       lua_pushstring(L, "keypressed");
       lua_pushstring(L, key_name(buf, e.key.keysym.sym));
       return 2;
@@ -90,6 +103,7 @@ top:
       return 2;
 
     case SDL_TEXTINPUT:
+      latency_input(LATENCY_TEXT, e.text.timestamp);
       lua_pushstring(L, "textinput");
       lua_pushstring(L, e.text.text);
       return 2;
@@ -133,8 +147,23 @@ top:
 
 
 static int f_wait_event(lua_State *L) {
-  double n = luaL_checknumber(L, 1);
-  lua_pushboolean(L, SDL_WaitEventTimeout(NULL, n * 1000));
+  /* waits for as long as it takes if no timeout is given; the timeout is
+  ** rounded up, so that it never returns before the timeout is up */
+  bool forever = lua_isnoneornil(L, 1);
+  double n = forever ? 0 : luaL_checknumber(L, 1);
+  trace_begin("system", "wait_event");
+  int res = forever ? SDL_WaitEvent(NULL)
+    : SDL_WaitEventTimeout(NULL, ceil(n * 1000));
+  trace_end();
+  lua_pushboolean(L, res);
+  return 1;
+}
+
+
+static int f_has_pending_input(lua_State *L) {
+  SDL_PumpEvents();
+  lua_pushboolean(L, SDL_HasEvents(SDL_KEYDOWN, SDL_TEXTINPUT)
+    || SDL_HasEvent(SDL_MOUSEBUTTONDOWN));
   return 1;
 }
 
@@ -192,7 +221,8 @@ static int f_set_window_mode(lua_State *L) {
 
 
 static int f_window_has_focus(lua_State *L) {
-  unsigned flags = SDL_GetWindowFlags(window);
+  /* with no window, when headless, the editor is always focused */
+  unsigned flags = window ? SDL_GetWindowFlags(window) : SDL_WINDOW_INPUT_FOCUS;
   lua_pushboolean(L, flags & SDL_WINDOW_INPUT_FOCUS);
   return 1;
 }
@@ -243,6 +273,7 @@ static int f_list_dir(lua_State *L) {
     return 2;
   }
 
+  trace_begin("system", "list_dir");
   lua_newtable(L);
   int i = 1;
   struct dirent *entry;
@@ -255,6 +286,7 @@ static int f_list_dir(lua_State *L) {
   }
 
   closedir(dir);
+  trace_end();
   return 1;
 }
 
@@ -328,6 +360,114 @@ static int f_get_time(lua_State *L) {
 }
 
 
+/* returns a table of each input event type's input-to-present latency, as
+** the count, mean and max in milliseconds and a histogram of 1ms buckets, the
+** last holding anything longer; the histograms are cleared if `reset` is set */
+static int f_get_input_latency(lua_State *L) {
+  static const char *names[] = { "keypressed", "textinput" };
+  lua_newtable(L);
+  for (int i = 0; i < LATENCY_KINDS; i++) {
+    const LatencyHistogram *h = latency_get(i);
+    lua_newtable(L);
+    lua_pushnumber(L, h->count);
+    lua_setfield(L, -2, "count");
+    lua_pushnumber(L, h->count ? h->total / h->count : 0);
+    lua_setfield(L, -2, "mean");
+    lua_pushnumber(L, h->max);
+    lua_setfield(L, -2, "max");
+    lua_createtable(L, LATENCY_BUCKETS, 0);
+    for (int j = 0; j < LATENCY_BUCKETS; j++) {
+      lua_pushnumber(L, h->buckets[j]);
+      lua_rawseti(L, -2, j + 1);
+    }
+    lua_setfield(L, -2, "buckets");
+    lua_setfield(L, -2, names[i]);
+  }
+  if (lua_toboolean(L, 1)) { latency_reset(); }
+  return 1;
+}
+
+
+/* opens a span named `name` in the trace, returning its depth which is
+** passed to `trace_end()` to close it along with any spans left open inside
+** it by an error */
+static int f_trace_begin(lua_State *L) {
+  const char *name = luaL_checkstring(L, 1);
+  lua_pushnumber(L, trace_begin("lua", name));
+  return 1;
+}
+
+
+static int f_trace_end(lua_State *L) {
+  int depth = luaL_checknumber(L, 1);
+  trace_end_to(depth);
+  return 0;
+}
+
+
+static int f_write_trace(lua_State *L) {
+  const char *filename = luaL_checkstring(L, 1);
+  FILE *fp = fopen(filename, "wb");
+  if (!fp || trace_write(fp) != 0) {
+    lua_pushnil(L);
+    lua_pushstring(L, strerror(errno));
+    if (fp) { fclose(fp); }
+    return 2;
+  }
+  fclose(fp);
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
+static int f_get_peak_memory(lua_State *L) {
+#if _WIN32
+  /* not available without linking psapi */
+  lua_pushnil(L);
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  #if __APPLE__
+    lua_pushnumber(L, usage.ru_maxrss);
+  #else
+    lua_pushnumber(L, usage.ru_maxrss * 1024.0);
+  #endif
+#endif
+  return 1;
+}
+
+
+/* returns the bytes in use by Lua, split into the small blocks served from
+** the allocator's pools and the large ones, the bytes of slabs reserved for
+** the pools, and the number of allocations and bytes allocated so far by the
+** type of object allocated */
+static int f_memory_stats(lua_State *L) {
+  AllocStats stats;
+  alloc_get_stats(L, &stats);
+  lua_newtable(L);
+  lua_pushnumber(L, lua_gc(L, LUA_GCCOUNT, 0) * 1024.0
+    + lua_gc(L, LUA_GCCOUNTB, 0));
+  lua_setfield(L, -2, "total");
+  lua_pushnumber(L, stats.small);
+  lua_setfield(L, -2, "small");
+  lua_pushnumber(L, stats.large);
+  lua_setfield(L, -2, "large");
+  lua_pushnumber(L, stats.pooled);
+  lua_setfield(L, -2, "pooled");
+  lua_newtable(L);
+  lua_newtable(L);
+  for (int i = 0; i < ALLOC_KINDS; i++) {
+    lua_pushnumber(L, stats.counts[i]);
+    lua_setfield(L, -3, alloc_kind_names[i]);
+    lua_pushnumber(L, stats.bytes[i]);
+    lua_setfield(L, -2, alloc_kind_names[i]);
+  }
+  lua_setfield(L, -3, "allocated");
+  lua_setfield(L, -2, "allocations");
+  return 1;
+}
+
+
 static int f_sleep(lua_State *L) {
   double n = luaL_checknumber(L, 1);
   SDL_Delay(n * 1000);
@@ -354,34 +494,621 @@ static int f_exec(lua_State *L) {
 
 
 static int f_fuzzy_match(lua_State *L) {
-  const char *str = luaL_checkstring(L, 1);
+  size_t len;
+  const char *str = luaL_checklstring(L, 1, &len);
   const char *ptn = luaL_checkstring(L, 2);
-  int score = 0;
-  int run = 0;
-
-  while (*str && *ptn) {
-    while (*str == ' ') { str++; }
-    while (*ptn == ' ') { ptn++; }
-    if (tolower(*str) == tolower(*ptn)) {
-      score += run * 10 - (*str != *ptn);
-      run++;
-      ptn++;
-    } else {
-      score -= 10;
-      run = 0;
+  int score;
+  if (!fuzzy_score(str, len, ptn, &score)) { return 0; }
+  lua_pushnumber(L, score);
+  return 1;
+}
+
+
+static int f_fuzzy_set(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  int count = lua_rawlen(L, 1);
+  const char **strs = malloc(count * (sizeof(*strs) + sizeof(size_t)) + 1);
+  if (!strs) { luaL_error(L, "buffer allocation failed"); }
+  size_t *lens = (size_t*) (strs + count);
+  for (int i = 0; i < count; i++) {
+    /* only strings are accepted, as they stay referenced by the table once
+    ** popped */
+    lua_rawgeti(L, 1, i + 1);
+    bool is_string = lua_type(L, -1) == LUA_TSTRING;
+    strs[i] = lua_tolstring(L, -1, &lens[i]);
+    lua_pop(L, 1);
+    if (!is_string) {
+      free(strs);
+      luaL_error(L, "expected string at index %d", i + 1);
+    }
+  }
+
+  FuzzySet **self = lua_newuserdata(L, sizeof(*self));
+  *self = fuzzy_new(strs, lens, count);
+  free(strs);
+  if (!*self) { luaL_error(L, "buffer allocation failed"); }
+  luaL_setmetatable(L, API_TYPE_FUZZYSET);
+  return 1;
+}
+
+
+static int f_fuzzy_set_match(lua_State *L) {
+  FuzzySet **self = luaL_checkudata(L, 1, API_TYPE_FUZZYSET);
+  const char *needle = luaL_checkstring(L, 2);
+  int max = luaL_optnumber(L, 3, -1);
+  int count;
+  trace_begin("system", "fuzzy_match");
+  const int *res = fuzzy_match(*self, needle, max, &count);
+  trace_end();
+  lua_createtable(L, count, 0);
+  for (int i = 0; i < count; i++) {
+    lua_pushnumber(L, res[i] + 1);
+    lua_rawseti(L, -2, i + 1);
+  }
+  return 1;
+}
+
+
+static int f_fuzzy_set_add(lua_State *L) {
+  FuzzySet **self = luaL_checkudata(L, 1, API_TYPE_FUZZYSET);
+  size_t len;
+  const char *str = luaL_checklstring(L, 2, &len);
+  int idx = fuzzy_add(*self, str, len);
+  if (idx < 0) { luaL_error(L, "buffer allocation failed"); }
+  lua_pushnumber(L, idx + 1);
+  return 1;
+}
+
+
+static int f_fuzzy_set_remove(lua_State *L) {
+  FuzzySet **self = luaL_checkudata(L, 1, API_TYPE_FUZZYSET);
+  int idx = luaL_checknumber(L, 2);
+  luaL_argcheck(L, idx >= 1 && idx <= fuzzy_count(*self), 2,
+    "index out of range");
+  fuzzy_remove(*self, idx - 1);
+  return 0;
+}
+
+
+static int f_fuzzy_set_gc(lua_State *L) {
+  FuzzySet **self = luaL_checkudata(L, 1, API_TYPE_FUZZYSET);
+  if (*self) { fuzzy_free(*self); }
+  return 0;
+}
+
+
+#define FIND_LINES_CHUNK 4096
+
+typedef struct {
+  const char **text;
+  size_t *len;
+  char *hit;
+  int count;
+  const char *needle;
+  size_t needle_len;
+} FindLines;
+
+
+static bool contains(const char *s, size_t len, const char *ptn, size_t ptn_len) {
+  if (ptn_len == 0) { return true; }
+  if (len < ptn_len) { return false; }
+  const char *end = s + len - ptn_len + 1;
+  while (s < end) {
+    s = memchr(s, *ptn, end - s);
+    if (!s) { return false; }
+    if (memcmp(s, ptn, ptn_len) == 0) { return true; }
+    s++;
+  }
+  return false;
+}
+
+
+static void find_lines_chunk(void *udata, int idx) {
+  FindLines *f = udata;
+  int last = (idx + 1) * FIND_LINES_CHUNK;
+  if (last > f->count) { last = f->count; }
+  for (int i = idx * FIND_LINES_CHUNK; i < last; i++) {
+    f->hit[i] = contains(f->text[i], f->len[i], f->needle, f->needle_len);
+  }
+}
+
+
+/* returns the indices of the lines containing `needle`, which can't contain
+** a newline as each line is searched on its own */
+static int f_find_lines(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  FindLines f;
+  f.needle = luaL_checklstring(L, 2, &f.needle_len);
+  luaL_argcheck(L, !memchr(f.needle, '\n', f.needle_len), 2,
+    "needle contains a newline");
+  f.count = lua_rawlen(L, 1);
+  f.text = malloc(f.count * (sizeof(*f.text) + sizeof(*f.len) + 1) + 1);
+  if (!f.text) { luaL_error(L, "buffer allocation failed"); }
+  f.len = (size_t*) (f.text + f.count);
+  f.hit = (char*) (f.len + f.count);
+
+  /* the strings stay referenced by the table while the workers read them, and
+  ** no lua code runs until they are done; other values aren't converted, as
+  ** nothing would reference the converted strings */
+  for (int i = 0; i < f.count; i++) {
+    lua_rawgeti(L, 1, i + 1);
+    bool is_string = lua_type(L, -1) == LUA_TSTRING;
+    f.text[i] = lua_tolstring(L, -1, &f.len[i]);
+    lua_pop(L, 1);
+    if (!is_string) {
+      free(f.text);
+      luaL_error(L, "expected string at index %d", i + 1);
+    }
+  }
+
+  int chunks = (f.count + FIND_LINES_CHUNK - 1) / FIND_LINES_CHUNK;
+  trace_begin("system", "find_lines");
+  parallel_for(chunks, find_lines_chunk, &f);
+  trace_end();
+
+  lua_newtable(L);
+  int n = 1;
+  for (int i = 0; i < f.count; i++) {
+    if (f.hit[i]) {
+      lua_pushnumber(L, i + 1);
+      lua_rawseti(L, -2, n++);
+    }
+  }
+  free(f.text);
+  return 1;
+}
+
+
+typedef struct {
+  Scan *scan;
+  int idx;
+} TreeScan;
+
+
+static int f_scan_tree(lua_State *L) {
+  const char *path = luaL_checkstring(L, 1);
+  ScanOptions opt = { NULL, 0, HUGE_VAL, false, -1 };
+
+  if (!lua_isnoneornil(L, 2)) {
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_getfield(L, 2, "size_limit");
+    opt.size_limit = luaL_optnumber(L, -1, HUGE_VAL);
+    lua_getfield(L, 2, "use_ignore_files");
+    opt.use_ignore_files = lua_toboolean(L, -1);
+    lua_getfield(L, 2, "monitor");
+    if (!lua_isnil(L, -1)) { opt.watch_fd = dirmonitor_get_fd(L, -1); }
+    lua_getfield(L, 2, "ignore");
+    /* the pattern array is userdata so it's freed even if an error is
+    ** raised; the strings stay referenced by the options table */
+    if (lua_isstring(L, -1)) {
+      opt.ignore = lua_newuserdata(L, sizeof(char*));
+      opt.ignore[opt.ignore_count++] = lua_tostring(L, -2);
+    } else if (lua_istable(L, -1)) {
+      int n = lua_rawlen(L, -1);
+      opt.ignore = lua_newuserdata(L, (n + 1) * sizeof(char*));
+      for (int i = 1; i <= n; i++) {
+        lua_rawgeti(L, -2, i);
+        opt.ignore[opt.ignore_count++] = luaL_checkstring(L, -1);
+        lua_pop(L, 1);
+      }
+    }
+  }
+
+  /* patterns the native matcher can't handle are left to the caller */
+  for (int i = 0; i < opt.ignore_count; i++) {
+    const char *err = pattern_check(opt.ignore[i]);
+    if (err) {
+      lua_pushnil(L);
+      lua_pushfstring(L, "bad ignore pattern %s: %s", opt.ignore[i], err);
+      return 2;
+    }
+  }
+
+  TreeScan *self = lua_newuserdata(L, sizeof(*self));
+  self->scan = NULL;
+  self->idx = 0;
+  luaL_setmetatable(L, API_TYPE_TREESCAN);
+  self->scan = scan_start(path, &opt);
+  if (!self->scan) { luaL_error(L, "failed to start scan"); }
+  return 1;
+}
+
+
+static int f_scan_read(lua_State *L) {
+  TreeScan *self = luaL_checkudata(L, 1, API_TYPE_TREESCAN);
+  int max = luaL_optnumber(L, 2, 1000);
+  lua_newtable(L);
+  if (!scan_done(self->scan)) { return 1; }
+
+  int count;
+  ScanEntry **entries = scan_entries(self->scan, &count);
+  if (self->idx >= count) { return 0; }
+  for (int i = 1; i <= max && self->idx < count; i++) {
+    ScanEntry *e = entries[self->idx++];
+    lua_createtable(L, 0, 4);
+    lua_pushstring(L, e->filename);
+    lua_setfield(L, -2, "filename");
+    lua_pushnumber(L, e->modified);
+    lua_setfield(L, -2, "modified");
+    lua_pushnumber(L, e->size);
+    lua_setfield(L, -2, "size");
+    if (e->type) {
+      lua_pushstring(L, e->type);
+      lua_setfield(L, -2, "type");
+    }
+    lua_rawseti(L, -2, i);
+  }
+  return 1;
+}
+
+
+static int f_scan_gc(lua_State *L) {
+  TreeScan *self = luaL_checkudata(L, 1, API_TYPE_TREESCAN);
+  if (self->scan) { scan_free(self->scan); }
+  return 0;
+}
+
+
+/* the ignore lists of the directories checked last, keyed by directory, as
+** loading one reads and parses the ignore files of the directory and all its
+** parents; the project scan clears them whenever it rescans */
+#define IGNORE_CACHE_SIZE 32
+
+static struct { char *dir; IgnoreList *list; } ignore_cache[IGNORE_CACHE_SIZE];
+static int ignore_cache_next;
+
+
+static IgnoreList* get_ignore_list(const char *path) {
+  /* only the parent directory of `path` decides which lists apply */
+  size_t n = 0;
+  for (const char *p = path; *p; p++) {
+    if (*p == '/' || *p == '\\') { n = p - path; }
+  }
+  for (int i = 0; i < IGNORE_CACHE_SIZE; i++) {
+    const char *dir = ignore_cache[i].dir;
+    if (dir && strlen(dir) == n && memcmp(dir, path, n) == 0) {
+      return ignore_cache[i].list;
+    }
+  }
+
+  char *dir = malloc(n + 1);
+  if (!dir) { return NULL; }
+  memcpy(dir, path, n);
+  dir[n] = '\0';
+  int i = ignore_cache_next;
+  ignore_cache_next = (i + 1) % IGNORE_CACHE_SIZE;
+  free(ignore_cache[i].dir);
+  ignore_release(ignore_cache[i].list);
+  ignore_cache[i].dir = dir;
+  ignore_cache[i].list = ignore_load_path(path);
+  return ignore_cache[i].list;
+}
+
+
+static int f_is_ignored(lua_State *L) {
+  const char *path = luaL_checkstring(L, 1);
+  bool is_dir = lua_toboolean(L, 2);
+  lua_pushboolean(L, ignore_match(get_ignore_list(path), path, is_dir));
+  return 1;
+}
+
+
+static int f_clear_ignore_cache(lua_State *L) {
+  for (int i = 0; i < IGNORE_CACHE_SIZE; i++) {
+    free(ignore_cache[i].dir);
+    ignore_release(ignore_cache[i].list);
+    ignore_cache[i].dir = NULL;
+    ignore_cache[i].list = NULL;
+  }
+  return 0;
+}
+
+
+static int f_mkdir(lua_State *L) {
+  const char *path = luaL_checkstring(L, 1);
+#ifdef _WIN32
+  int err = mkdir(path);
+#else
+  int err = mkdir(path, 0755);
+#endif
+  if (err < 0 && errno != EEXIST) {
+    lua_pushnil(L);
+    lua_pushstring(L, strerror(errno));
+    return 2;
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
+/* file lists are cached in native byte order as:
+**   magic, key length, key, entry count,
+**   then per entry: type, modified, size, filename length, filename */
+#define FILE_LIST_MAGIC "LFL1"
+
+static const char *file_types[] = { "file", "dir" };
+
+
+static void write_u32(FILE *fp, unsigned n) {
+  uint32_t x = n;
+  fwrite(&x, sizeof(x), 1, fp);
+}
+
+
+static void write_f64(FILE *fp, double n) {
+  fwrite(&n, sizeof(n), 1, fp);
+}
+
+
+static int f_save_file_list(lua_State *L) {
+  const char *filename = luaL_checkstring(L, 1);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  size_t key_len;
+  const char *key = luaL_optlstring(L, 3, "", &key_len);
+
+  /* write to a temporary file first so a reader never sees a partial list */
+  char tmp[1024];
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp", filename) >= (int) sizeof(tmp)) {
+    luaL_error(L, "filename too long");
+  }
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp) {
+    lua_pushnil(L);
+    lua_pushstring(L, strerror(errno));
+    return 2;
+  }
+
+  int count = lua_rawlen(L, 2);
+  fwrite(FILE_LIST_MAGIC, 4, 1, fp);
+  write_u32(fp, key_len);
+  fwrite(key, 1, key_len, fp);
+  write_u32(fp, count);
+
+  for (int i = 1; i <= count; i++) {
+    lua_rawgeti(L, 2, i);
+    lua_getfield(L, -1, "filename");
+    lua_getfield(L, -2, "type");
+    lua_getfield(L, -3, "modified");
+    lua_getfield(L, -4, "size");
+    size_t len;
+    const char *name = lua_tolstring(L, -4, &len);
+    const char *type = lua_tostring(L, -3);
+    if (!name) {
+      fclose(fp);
+      remove(tmp);
+      luaL_error(L, "expected filename at index %d", i);
     }
-    str++;
+    unsigned char t = 0;
+    for (int j = 0; type && j < 2; j++) {
+      if (strcmp(type, file_types[j]) == 0) { t = j + 1; }
+    }
+    fputc(t, fp);
+    write_f64(fp, lua_tonumber(L, -2));
+    write_f64(fp, lua_tonumber(L, -1));
+    write_u32(fp, len);
+    fwrite(name, 1, len, fp);
+    lua_pop(L, 5);
   }
-  if (*ptn) { return 0; }
 
-  lua_pushnumber(L, score - (int) strlen(str));
+  bool ok = !ferror(fp);
+  ok = (fclose(fp) == 0) && ok;
+#ifdef _WIN32
+  if (ok) { remove(filename); }
+#endif
+  if (!ok || rename(tmp, filename) != 0) {
+    int err = errno;
+    remove(tmp);
+    lua_pushnil(L);
+    lua_pushstring(L, strerror(err));
+    return 2;
+  }
+  lua_pushboolean(L, 1);
   return 1;
 }
 
 
+typedef struct {
+  const char *p, *end;
+} Reader;
+
+
+static const void* read_bytes(Reader *r, size_t n) {
+  if ((size_t) (r->end - r->p) < n) { return NULL; }
+  const void *res = r->p;
+  r->p += n;
+  return res;
+}
+
+
+static bool read_u32(Reader *r, uint32_t *n) {
+  const void *p = read_bytes(r, sizeof(*n));
+  if (p) { memcpy(n, p, sizeof(*n)); }
+  return p != NULL;
+}
+
+
+static bool read_f64(Reader *r, double *n) {
+  const void *p = read_bytes(r, sizeof(*n));
+  if (p) { memcpy(n, p, sizeof(*n)); }
+  return p != NULL;
+}
+
+
+static int f_load_file_list(lua_State *L) {
+  const char *filename = luaL_checkstring(L, 1);
+  size_t key_len;
+  const char *key = luaL_optlstring(L, 2, "", &key_len);
+
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) { return 0; }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  char *buf = size > 0 ? malloc(size) : NULL;
+  bool ok = buf && fread(buf, 1, size, fp) == (size_t) size;
+  fclose(fp);
+  if (!ok) { free(buf); return 0; }
+
+  /* any mismatch or truncation discards the whole cache */
+  Reader r = { buf, buf + size };
+  uint32_t n, count;
+  const char *p = read_bytes(&r, 4);
+  ok = p && memcmp(p, FILE_LIST_MAGIC, 4) == 0;
+  ok = ok && read_u32(&r, &n) && n == key_len;
+  ok = ok && (p = read_bytes(&r, n)) && memcmp(p, key, n) == 0;
+  ok = ok && read_u32(&r, &count) && count <= (uint32_t) size;
+  if (!ok) { free(buf); return 0; }
+
+  lua_createtable(L, count, 0);
+  for (uint32_t i = 1; i <= count; i++) {
+    const unsigned char *t = read_bytes(&r, 1);
+    double modified, sz;
+    ok = t && *t <= 2 && read_f64(&r, &modified) && read_f64(&r, &sz);
+    ok = ok && read_u32(&r, &n) && (p = read_bytes(&r, n));
+    if (!ok) { free(buf); return 0; }
+    lua_createtable(L, 0, 4);
+    lua_pushlstring(L, p, n);
+    lua_setfield(L, -2, "filename");
+    lua_pushnumber(L, modified);
+    lua_setfield(L, -2, "modified");
+    lua_pushnumber(L, sz);
+    lua_setfield(L, -2, "size");
+    if (*t) {
+      lua_pushstring(L, file_types[*t - 1]);
+      lua_setfield(L, -2, "type");
+    }
+    lua_rawseti(L, -2, i);
+  }
+  free(buf);
+  return 1;
+}
+
+
+static int f_symbol_index(lua_State *L) {
+  const char *pattern = luaL_checkstring(L, 1);
+  const char *err = pattern_check(pattern);
+  if (err) {
+    lua_pushnil(L);
+    lua_pushfstring(L, "bad symbol pattern %s: %s", pattern, err);
+    return 2;
+  }
+  SymbolIndex **self = lua_newuserdata(L, sizeof(*self));
+  *self = symbols_new(pattern);
+  luaL_setmetatable(L, API_TYPE_SYMBOLINDEX);
+  return 1;
+}
+
+
+static int push_symbols(lua_State *L, const char **res, int count) {
+  lua_createtable(L, count, 0);
+  for (int i = 0; i < count; i++) {
+    lua_pushstring(L, res[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  return 1;
+}
+
+
+static int f_symbol_index_prefix(lua_State *L) {
+  SymbolIndex **self = luaL_checkudata(L, 1, API_TYPE_SYMBOLINDEX);
+  size_t len;
+  const char *prefix = luaL_checklstring(L, 2, &len);
+  int max = luaL_optnumber(L, 3, -1);
+  int count;
+  const char **res = symbols_prefix(*self, prefix, len, max, &count);
+  return push_symbols(L, res, count);
+}
+
+
+static int f_symbol_index_match(lua_State *L) {
+  SymbolIndex **self = luaL_checkudata(L, 1, API_TYPE_SYMBOLINDEX);
+  const char *needle = luaL_checkstring(L, 2);
+  int max = luaL_optnumber(L, 3, -1);
+  int count;
+  trace_begin("system", "symbols_match");
+  const char **res = symbols_match(*self, needle, max, &count);
+  trace_end();
+  return push_symbols(L, res, count);
+}
+
+
+static int f_symbol_index_len(lua_State *L) {
+  SymbolIndex **self = luaL_checkudata(L, 1, API_TYPE_SYMBOLINDEX);
+  lua_pushnumber(L, symbols_count(*self));
+  return 1;
+}
+
+
+static int f_symbol_index_new_doc(lua_State *L) {
+  SymbolIndex **self = luaL_checkudata(L, 1, API_TYPE_SYMBOLINDEX);
+  SymbolDoc **doc = lua_newuserdata(L, sizeof(*doc));
+  *doc = symbols_new_doc(*self);
+  luaL_setmetatable(L, API_TYPE_SYMBOLDOC);
+  return 1;
+}
+
+
+static int f_symbol_index_gc(lua_State *L) {
+  SymbolIndex **self = luaL_checkudata(L, 1, API_TYPE_SYMBOLINDEX);
+  symbols_release(*self);
+  return 0;
+}
+
+
+static int f_symbol_doc_splice(lua_State *L) {
+  SymbolDoc **self = luaL_checkudata(L, 1, API_TYPE_SYMBOLDOC);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  int line = luaL_checknumber(L, 3);
+  int remove = luaL_checknumber(L, 4);
+  int insert = luaL_checknumber(L, 5);
+  int count = symbols_line_count(*self);
+  if (line < 1 || line > count + 1) {
+    return luaL_argerror(L, 3, "line out of range");
+  }
+  if (remove < 0 || line + remove - 1 > count) {
+    return luaL_argerror(L, 4, "line count out of range");
+  }
+  if (insert < 0) { return luaL_argerror(L, 5, "line count out of range"); }
+
+  const char **texts = malloc(insert * (sizeof(*texts) + sizeof(size_t)) + 1);
+  if (!texts) { luaL_error(L, "buffer allocation failed"); }
+  size_t *lens = (size_t*) (texts + insert);
+  for (int i = 0; i < insert; i++) {
+    /* only strings are accepted, as they stay referenced by the table once
+    ** popped */
+    lua_rawgeti(L, 2, line + i);
+    bool is_string = lua_type(L, -1) == LUA_TSTRING;
+    texts[i] = lua_tolstring(L, -1, &lens[i]);
+    lua_pop(L, 1);
+    if (!is_string) {
+      free(texts);
+      luaL_error(L, "expected string at index %d", line + i);
+    }
+  }
+  symbols_splice(*self, line - 1, remove, texts, lens, insert);
+  free(texts);
+  return 0;
+}
+
+
+static int f_symbol_doc_get_line_count(lua_State *L) {
+  SymbolDoc **self = luaL_checkudata(L, 1, API_TYPE_SYMBOLDOC);
+  lua_pushnumber(L, symbols_line_count(*self));
+  return 1;
+}
+
+
+static int f_symbol_doc_gc(lua_State *L) {
+  SymbolDoc **self = luaL_checkudata(L, 1, API_TYPE_SYMBOLDOC);
+  symbols_free_doc(*self);
+  return 0;
+}
+
+
 static const luaL_Reg lib[] = {
   { "poll_event",          f_poll_event          },
   { "wait_event",          f_wait_event          },
+  { "has_pending_input",   f_has_pending_input   },
   { "set_cursor",          f_set_cursor          },
   { "set_window_title",    f_set_window_title    },
   { "set_window_mode",     f_set_window_mode     },
@@ -394,14 +1121,76 @@ static const luaL_Reg lib[] = {
   { "get_clipboard",       f_get_clipboard       },
   { "set_clipboard",       f_set_clipboard       },
   { "get_time",            f_get_time            },
+  { "get_input_latency",   f_get_input_latency   },
+  { "trace_begin",         f_trace_begin         },
+  { "trace_end",           f_trace_end           },
+  { "write_trace",         f_write_trace         },
+  { "get_peak_memory",     f_get_peak_memory     },
+  { "memory_stats",        f_memory_stats        },
   { "sleep",               f_sleep               },
   { "exec",                f_exec                },
   { "fuzzy_match",         f_fuzzy_match         },
+  { "fuzzy_set",           f_fuzzy_set           },
+  { "symbol_index",        f_symbol_index        },
+  { "find_lines",          f_find_lines          },
+  { "scan_tree",           f_scan_tree           },
+  { "is_ignored",          f_is_ignored          },
+  { "clear_ignore_cache",  f_clear_ignore_cache  },
+  { "mkdir",               f_mkdir               },
+  { "save_file_list",      f_save_file_list      },
+  { "load_file_list",      f_load_file_list      },
+  { NULL, NULL }
+};
+
+
+static const luaL_Reg scan_lib[] = {
+  { "__gc",                f_scan_gc             },
+  { "read",                f_scan_read           },
+  { NULL, NULL }
+};
+
+
+static const luaL_Reg fuzzy_set_lib[] = {
+  { "__gc",                f_fuzzy_set_gc        },
+  { "match",               f_fuzzy_set_match     },
+  { "add",                 f_fuzzy_set_add       },
+  { "remove",              f_fuzzy_set_remove    },
+  { NULL, NULL }
+};
+
+
+static const luaL_Reg symbol_index_lib[] = {
+  { "__gc",                f_symbol_index_gc     },
+  { "__len",               f_symbol_index_len    },
+  { "new_doc",             f_symbol_index_new_doc },
+  { "prefix",              f_symbol_index_prefix },
+  { "match",               f_symbol_index_match  },
+  { NULL, NULL }
+};
+
+
+static const luaL_Reg symbol_doc_lib[] = {
+  { "__gc",                f_symbol_doc_gc       },
+  { "splice",              f_symbol_doc_splice   },
+  { "get_line_count",      f_symbol_doc_get_line_count },
   { NULL, NULL }
 };
 
 
+static void new_metatable(lua_State *L, const char *name, const luaL_Reg *l) {
+  luaL_newmetatable(L, name);
+  luaL_setfuncs(L, l, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+}
+
+
 int luaopen_system(lua_State *L) {
+  new_metatable(L, API_TYPE_TREESCAN, scan_lib);
+  new_metatable(L, API_TYPE_FUZZYSET, fuzzy_set_lib);
+  new_metatable(L, API_TYPE_SYMBOLINDEX, symbol_index_lib);
+  new_metatable(L, API_TYPE_SYMBOLDOC, symbol_doc_lib);
   luaL_newlib(L, lib);
   return 1;
 }
@@ -0,0 +1,347 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fuzzy.h"
+#include "parallel.h"
+
+/* a set of strings that can be fuzzy matched against repeatedly -- the set
+** keeps its own copy of the strings along with a lowercase copy, which is
+** used to cheaply reject strings that don't contain the needle's characters
+** in order before scoring them. Scoring is split into chunks which run in
+** parallel, each chunk keeping only its best `max` results, which are then
+** merged. Results are ordered by score, ties by index. The set remembers
+** which strings matched the last needle: a string that doesn't match a needle
+** can't match that needle with more characters appended, so when the new
+** needle extends the last one only the previous matches are scored. Strings
+** can be added to the set, and removed or restored by index, without
+** discarding the last matches: added and restored strings are scored on the
+** next narrowed match as well, and removed strings are skipped until they
+** are restored. This is only meant to be used from the main thread */
+
+#define CHUNK_SIZE 4096
+
+/* per string flags */
+#define REMOVED 1 /* skipped when matching */
+#define LIVE    2 /* in `live`, the strings which matched the last needle */
+
+typedef struct {
+  int score, idx;
+} Hit;
+
+struct FuzzySet {
+  char *text, *lower;
+  size_t text_size, text_capacity;
+  size_t *offset, *len;
+  unsigned char *flags;
+  int count, capacity;
+  Hit *hits;
+  int *res;
+  int *live;
+  int live_count;
+  char *last_needle;
+};
+
+typedef struct {
+  FuzzySet *set;
+  const char *needle;
+  const char *lneedle;
+  int max;
+  int count;
+  bool narrow;
+  int *counts, *live_counts;
+} Match;
+
+static unsigned char lower[256];
+
+
+static void init_lower(void) {
+  for (int i = 0; i < 256; i++) {
+    lower[i] = (i >= 'A' && i <= 'Z') ? i - 'A' + 'a' : i;
+  }
+}
+
+
+bool fuzzy_score(const char *str, size_t len, const char *ptn, int *res) {
+  const unsigned char *s = (const unsigned char*) str;
+  const unsigned char *p = (const unsigned char*) ptn;
+  const unsigned char *end = s + len;
+  int score = 0;
+  int run = 0;
+
+  if (!lower['A']) { init_lower(); }
+  while (s < end && *p) {
+    while (s < end && *s == ' ') { s++; }
+    while (*p == ' ') { p++; }
+    if (s == end) { break; }
+    if (lower[*s] == lower[*p]) {
+      score += run * 10 - (*s != *p);
+      run++;
+      p++;
+    } else {
+      score -= 10;
+      run = 0;
+    }
+    s++;
+  }
+  if (*p) { return false; }
+
+  *res = score - (int) (end - s);
+  return true;
+}
+
+
+static bool has_chars(const char *s, size_t len, const char *chars) {
+  const char *end = s + len;
+  for (; *chars; chars++) {
+    s = memchr(s, *chars, end - s);
+    if (!s) { return false; }
+    s++;
+  }
+  return true;
+}
+
+
+static bool better(Hit a, Hit b) {
+  return a.score > b.score || (a.score == b.score && a.idx < b.idx);
+}
+
+
+static int compare_hit(const void *a, const void *b) {
+  return better(*(Hit*) a, *(Hit*) b) ? -1 : 1;
+}
+
+
+static void sift_down(Hit *h, int n, int i) {
+  for (;;) {
+    int worst = i, l = i * 2 + 1, r = l + 1;
+    if (l < n && better(h[worst], h[l])) { worst = l; }
+    if (r < n && better(h[worst], h[r])) { worst = r; }
+    if (worst == i) { return; }
+    Hit tmp = h[i]; h[i] = h[worst]; h[worst] = tmp;
+    i = worst;
+  }
+}
+
+
+/* moves the best `max` hits (or all, if `max` is negative) to the front of
+** `h` in order and returns their count */
+static int select_top(Hit *h, int n, int max) {
+  if (max >= 0 && n > max) {
+    /* keep the best `max` hits in a heap with the worst one at the root */
+    for (int i = max / 2 - 1; i >= 0; i--) { sift_down(h, max, i); }
+    for (int i = max; i < n; i++) {
+      if (max > 0 && better(h[i], h[0])) {
+        h[0] = h[i];
+        sift_down(h, max, 0);
+      }
+    }
+    n = max;
+  }
+  qsort(h, n, sizeof(*h), compare_hit);
+  return n;
+}
+
+
+static bool grow(FuzzySet *set, int capacity) {
+  size_t n = capacity + 1;
+  void *p;
+  if (!(p = realloc(set->offset, n * sizeof(*set->offset)))) { return false; }
+  set->offset = p;
+  if (!(p = realloc(set->len, n * sizeof(*set->len)))) { return false; }
+  set->len = p;
+  if (!(p = realloc(set->flags, n * sizeof(*set->flags)))) { return false; }
+  set->flags = p;
+  if (!(p = realloc(set->hits, n * sizeof(*set->hits)))) { return false; }
+  set->hits = p;
+  if (!(p = realloc(set->res, n * sizeof(*set->res)))) { return false; }
+  set->res = p;
+  if (!(p = realloc(set->live, n * sizeof(*set->live)))) { return false; }
+  set->live = p;
+  set->capacity = capacity;
+  return true;
+}
+
+
+static bool grow_text(FuzzySet *set, size_t capacity) {
+  void *p = realloc(set->text, capacity + 1);
+  if (!p) { return false; }
+  set->text = p;
+  if (!(p = realloc(set->lower, capacity + 1))) { return false; }
+  set->lower = p;
+  set->text_capacity = capacity;
+  return true;
+}
+
+
+/* copies a string into the set, which must have room for it */
+static int push_string(FuzzySet *set, const char *str, size_t len) {
+  int idx = set->count++;
+  size_t offset = set->text_size;
+  char *dst = set->text + offset;
+  memcpy(dst, str, len);
+  dst[len] = '\0';
+  for (size_t j = 0; j <= len; j++) {
+    set->lower[offset + j] = lower[(unsigned char) dst[j]];
+  }
+  set->offset[idx] = offset;
+  set->len[idx] = len;
+  set->flags[idx] = 0;
+  set->text_size += len + 1;
+  return idx;
+}
+
+
+FuzzySet* fuzzy_new(const char **strs, const size_t *lens, int count) {
+  FuzzySet *set = calloc(1, sizeof(*set));
+  if (!set) { return NULL; }
+  if (!lower['A']) { init_lower(); }
+
+  size_t total = 0;
+  for (int i = 0; i < count; i++) { total += lens[i] + 1; }
+  if (!grow_text(set, total) || !grow(set, count)) {
+    fuzzy_free(set);
+    return NULL;
+  }
+  for (int i = 0; i < count; i++) { push_string(set, strs[i], lens[i]); }
+  return set;
+}
+
+
+/* adds a string to the end of the set and returns its index, or -1 if the
+** set could not be grown */
+int fuzzy_add(FuzzySet *set, const char *str, size_t len) {
+  if (set->count == set->capacity
+    && !grow(set, set->capacity ? set->capacity * 2 : 256))
+  {
+    return -1;
+  }
+  if (set->text_size + len + 1 > set->text_capacity
+    && !grow_text(set, (set->text_capacity + len + 1) * 2))
+  {
+    return -1;
+  }
+  int idx = push_string(set, str, len);
+  set->live[set->live_count++] = idx;
+  set->flags[idx] |= LIVE;
+  return idx;
+}
+
+
+int fuzzy_count(FuzzySet *set) {
+  return set->count;
+}
+
+
+void fuzzy_remove(FuzzySet *set, int idx) {
+  set->flags[idx] |= REMOVED;
+}
+
+
+void fuzzy_restore(FuzzySet *set, int idx) {
+  set->flags[idx] &= ~REMOVED;
+  if (!(set->flags[idx] & LIVE)) {
+    set->live[set->live_count++] = idx;
+    set->flags[idx] |= LIVE;
+  }
+}
+
+
+static void match_chunk(void *udata, int idx) {
+  Match *m = udata;
+  FuzzySet *set = m->set;
+  int first = idx * CHUNK_SIZE;
+  int last = first + CHUNK_SIZE;
+  if (last > m->count) { last = m->count; }
+
+  /* the matches are written back over this chunk's part of `live`, which is
+  ** never ahead of the part being read */
+  Hit *hits = set->hits + first;
+  int *live = set->live + first;
+  int n = 0;
+  for (int j = first; j < last; j++) {
+    int i = m->narrow ? set->live[j] : j;
+    size_t offset = set->offset[i];
+    int score;
+    if (!(set->flags[i] & REMOVED)
+      && has_chars(set->lower + offset, set->len[i], m->lneedle)
+      && fuzzy_score(set->text + offset, set->len[i], m->needle, &score))
+    {
+      hits[n].score = score;
+      hits[n].idx = i;
+      live[n] = i;
+      set->flags[i] |= LIVE;
+      n++;
+    } else {
+      set->flags[i] &= ~LIVE;
+    }
+  }
+  m->live_counts[idx] = n;
+  m->counts[idx] = select_top(hits, n, m->max);
+}
+
+
+/* returns the indices of the best `max` matches for `needle` (all matches if
+** `max` is negative); the result is valid until the next call */
+const int* fuzzy_match(FuzzySet *set, const char *needle, int max, int *count) {
+  /* narrow the last matches if the needle was appended to, else start over */
+  const char *last = set->last_needle;
+  bool narrow = last && strncmp(needle, last, strlen(last)) == 0;
+  int n = narrow ? set->live_count : set->count;
+
+  int chunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  char *lneedle = malloc(strlen(needle) + 1);
+  char *last_needle = malloc(strlen(needle) + 1);
+  int *counts = malloc(chunks * 2 * sizeof(*counts) + 1);
+  if (!lneedle || !last_needle || !counts) {
+    free(lneedle);
+    free(last_needle);
+    free(counts);
+    *count = 0;
+    return set->res;
+  }
+
+  /* spaces are skipped when matching */
+  char *p = lneedle;
+  for (const char *s = needle; *s; s++) {
+    if (*s != ' ') { *p++ = lower[(unsigned char) *s]; }
+  }
+  *p = '\0';
+
+  Match m = { set, needle, lneedle, max, n, narrow, counts, counts + chunks };
+  parallel_for(chunks, match_chunk, &m);
+
+  /* gather each chunk's matches and best hits, then select the overall best */
+  n = 0;
+  int live = 0;
+  for (int i = 0; i < chunks; i++) {
+    int offset = i * CHUNK_SIZE;
+    memmove(set->hits + n, set->hits + offset, counts[i] * sizeof(Hit));
+    memmove(set->live + live, set->live + offset,
+      m.live_counts[i] * sizeof(int));
+    n += counts[i];
+    live += m.live_counts[i];
+  }
+  n = select_top(set->hits, n, max);
+  for (int i = 0; i < n; i++) { set->res[i] = set->hits[i].idx; }
+
+  set->live_count = live;
+  free(set->last_needle);
+  set->last_needle = strcpy(last_needle, needle);
+  free(lneedle);
+  free(counts);
+  *count = n;
+  return set->res;
+}
+
+
+void fuzzy_free(FuzzySet *set) {
+  free(set->text);
+  free(set->lower);
+  free(set->offset);
+  free(set->len);
+  free(set->flags);
+  free(set->hits);
+  free(set->res);
+  free(set->live);
+  free(set->last_needle);
+  free(set);
+}
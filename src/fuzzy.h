@@ -0,0 +1,18 @@
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct FuzzySet FuzzySet;
+
+bool fuzzy_score(const char *str, size_t len, const char *ptn, int *score);
+FuzzySet* fuzzy_new(const char **strs, const size_t *lens, int count);
+int fuzzy_count(FuzzySet *set);
+int fuzzy_add(FuzzySet *set, const char *str, size_t len);
+void fuzzy_remove(FuzzySet *set, int idx);
+void fuzzy_restore(FuzzySet *set, int idx);
+const int* fuzzy_match(FuzzySet *set, const char *needle, int max, int *count);
+void fuzzy_free(FuzzySet *set);
+
+#endif
@@ -0,0 +1,240 @@
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ignore.h"
+
+/* .gitignore and .ignore rules -- each directory containing ignore files gets
+** an IgnoreList holding that directory's rules and a reference to the list of
+** its parent directory; directories without ignore files share their parent's
+** list. A path is checked against the rules of the deepest directory first
+** and the last matching rule of a file decides. Lists are immutable once
+** loaded and reference counted, so they can be shared between threads */
+
+#define MAX_LINE 1024
+
+#ifdef _WIN32
+  #define IS_SEP(c) ((c) == '/' || (c) == '\\')
+#else
+  #define IS_SEP(c) ((c) == '/')
+#endif
+
+typedef struct {
+  char *glob;
+  bool negate, dir_only, anchored;
+} IgnoreRule;
+
+struct IgnoreList {
+  IgnoreList *parent;
+  char *base;
+  IgnoreRule *rules;
+  int count;
+  SDL_atomic_t refs;
+};
+
+
+static bool match_class(const char **pp, char c) {
+  const char *p = *pp + 1;
+  bool negate = (*p == '!' || *p == '^');
+  if (negate) { p++; }
+  bool res = false;
+  /* a ']' right after the '[' is part of the class */
+  do {
+    if (!*p) { return false; }
+    if (p[1] == '-' && p[2] && p[2] != ']') {
+      if (*p <= c && c <= p[2]) { res = true; }
+      p += 3;
+    } else {
+      if (*p == '\\' && p[1]) { p++; }
+      if (*p == c) { res = true; }
+      p++;
+    }
+  } while (*p != ']');
+  *pp = p;
+  return res != negate;
+}
+
+
+static bool glob_match(const char *p, const char *s) {
+  for (; *p; p++, s++) {
+    switch (*p) {
+      case '*':
+        if (p[1] == '*') {
+          p += 2;
+          if (*p == '/') {
+            /* "**" followed by a slash matches zero or more directories */
+            p++;
+            for (;;) {
+              if (glob_match(p, s)) { return true; }
+              while (*s && *s != '/') { s++; }
+              if (!*s++) { return false; }
+            }
+          }
+          for (;; s++) {
+            if (glob_match(p, s)) { return true; }
+            if (!*s) { return false; }
+          }
+        }
+        for (p++;; s++) {
+          if (glob_match(p, s)) { return true; }
+          if (!*s || *s == '/') { return false; }
+        }
+      case '?':
+        if (!*s || *s == '/') { return false; }
+        break;
+      case '[':
+        if (!*s || *s == '/' || !match_class(&p, *s)) { return false; }
+        break;
+      case '\\':
+        if (p[1]) { p++; }
+        /* fallthrough */
+      default:
+        if (*p != *s) { return false; }
+        break;
+    }
+  }
+  return !*s;
+}
+
+
+static bool rule_match(IgnoreRule *r, const char *path, bool is_dir) {
+  if (r->dir_only && !is_dir) { return false; }
+  if (!r->anchored) {
+    const char *name = strrchr(path, '/');
+    path = name ? name + 1 : path;
+  }
+  return glob_match(r->glob, path);
+}
+
+
+static void add_rule(IgnoreList *list, char *line, int *capacity) {
+  /* strip line ending and unescaped trailing spaces */
+  int len = strlen(line);
+  while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) { len--; }
+  while (len > 0 && line[len - 1] == ' ' && (len < 2 || line[len - 2] != '\\')) { len--; }
+  line[len] = '\0';
+  if (len == 0 || *line == '#') { return; }
+
+  IgnoreRule r = { NULL, false, false, false };
+  if (*line == '!') {
+    r.negate = true;
+    line++;
+  } else if (*line == '\\' && (line[1] == '!' || line[1] == '#')) {
+    line++;
+  }
+  len = strlen(line);
+  if (len > 0 && line[len - 1] == '/') {
+    r.dir_only = true;
+    line[--len] = '\0';
+  }
+  if (len == 0) { return; }
+  /* a slash at the start or in the middle anchors the rule to its directory */
+  r.anchored = strchr(line, '/') != NULL;
+  if (*line == '/') { line++; }
+
+  if (list->count == *capacity) {
+    *capacity = *capacity ? *capacity * 2 : 16;
+    IgnoreRule *p = realloc(list->rules, *capacity * sizeof(IgnoreRule));
+    if (!p) { return; }
+    list->rules = p;
+  }
+  r.glob = strdup(line);
+  if (r.glob) { list->rules[list->count++] = r; }
+}
+
+
+static void load_file(IgnoreList *list, const char *dir, const char *name,
+  int *capacity
+) {
+  char filename[MAX_LINE];
+  snprintf(filename, sizeof(filename), "%s/%s", dir, name);
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) { return; }
+  char line[MAX_LINE];
+  while (fgets(line, sizeof(line), fp)) {
+    add_rule(list, line, capacity);
+  }
+  fclose(fp);
+}
+
+
+IgnoreList* ignore_load_dir(IgnoreList *parent, const char *dir) {
+  IgnoreList *list = calloc(1, sizeof(IgnoreList));
+  if (!list) { goto inherit; }
+  int capacity = 0;
+  load_file(list, dir, ".gitignore", &capacity);
+  load_file(list, dir, ".ignore", &capacity);
+  if (list->count == 0) {
+    free(list->rules);
+    free(list);
+    goto inherit;
+  }
+  list->base = strdup(strcmp(dir, ".") == 0 ? "" : dir);
+  list->parent = parent;
+  if (parent) { SDL_AtomicAdd(&parent->refs, 1); }
+  SDL_AtomicSet(&list->refs, 1);
+  return list;
+
+inherit:
+  if (parent) { SDL_AtomicAdd(&parent->refs, 1); }
+  return parent;
+}
+
+
+IgnoreList* ignore_load_path(const char *path) {
+  /* loads the lists of all directories from "." down to the parent of the
+  ** relative `path` */
+  IgnoreList *list = NULL;
+  char dir[MAX_LINE];
+  if (strcmp(path, ".") == 0 || IS_SEP(*path) || strlen(path) >= MAX_LINE) {
+    return NULL;
+  }
+  strcpy(dir, ".");
+  list = ignore_load_dir(NULL, dir);
+  for (const char *p = path; *p; p++) {
+    if (IS_SEP(*p)) {
+      memcpy(dir, path, p - path);
+      dir[p - path] = '\0';
+      IgnoreList *child = ignore_load_dir(list, dir);
+      ignore_release(list);
+      list = child;
+    }
+  }
+  return list;
+}
+
+
+bool ignore_match(IgnoreList *list, const char *path, bool is_dir) {
+  char buf[MAX_LINE];
+  for (; list; list = list->parent) {
+    /* get the path relative to the list's directory, with '/' separators */
+    int n = strlen(list->base);
+    const char *rel = path;
+    if (n > 0) {
+      if (strncmp(path, list->base, n) != 0 || !IS_SEP(path[n])) { continue; }
+      rel = path + n + 1;
+    }
+    if (strlen(rel) >= sizeof(buf)) { return false; }
+    char *q = buf;
+    for (const char *p = rel; *p; p++) { *q++ = IS_SEP(*p) ? '/' : *p; }
+    *q = '\0';
+
+    for (int i = list->count - 1; i >= 0; i--) {
+      IgnoreRule *r = &list->rules[i];
+      if (rule_match(r, buf, is_dir)) { return !r->negate; }
+    }
+  }
+  return false;
+}
+
+
+void ignore_release(IgnoreList *list) {
+  if (!list || SDL_AtomicAdd(&list->refs, -1) != 1) { return; }
+  for (int i = 0; i < list->count; i++) {
+    free(list->rules[i].glob);
+  }
+  free(list->rules);
+  free(list->base);
+  ignore_release(list->parent);
+  free(list);
+}
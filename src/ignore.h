@@ -0,0 +1,13 @@
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#include <stdbool.h>
+
+typedef struct IgnoreList IgnoreList;
+
+IgnoreList* ignore_load_dir(IgnoreList *parent, const char *dir);
+IgnoreList* ignore_load_path(const char *path);
+bool ignore_match(IgnoreList *list, const char *path, bool is_dir);
+void ignore_release(IgnoreList *list);
+
+#endif
@@ -0,0 +1,48 @@
+#include <SDL2/SDL.h>
+#include <string.h>
+#include "latency.h"
+
+/* histograms of the time from input events arriving to the frame showing
+** their effect being presented -- times are SDL tick counts in milliseconds,
+** each bucket counting one millisecond with the last bucket holding anything
+** longer. Every event since the last frame adds a sample when it's presented;
+** events past PENDING_MAX of a kind within one frame aren't measured */
+
+#define PENDING_MAX 256
+
+static LatencyHistogram histograms[LATENCY_KINDS];
+static uint32_t pending[LATENCY_KINDS][PENDING_MAX];
+static int pending_count[LATENCY_KINDS];
+
+
+void latency_input(int kind, uint32_t timestamp) {
+  if (pending_count[kind] < PENDING_MAX) {
+    pending[kind][pending_count[kind]++] = timestamp;
+  }
+}
+
+
+void latency_present(void) {
+  uint32_t now = SDL_GetTicks();
+  for (int i = 0; i < LATENCY_KINDS; i++) {
+    LatencyHistogram *h = &histograms[i];
+    for (int j = 0; j < pending_count[i]; j++) {
+      uint32_t ms = now - pending[i][j];
+      h->count++;
+      h->total += ms;
+      if (ms > h->max) { h->max = ms; }
+      h->buckets[ms < LATENCY_BUCKETS - 1 ? ms : LATENCY_BUCKETS - 1]++;
+    }
+    pending_count[i] = 0;
+  }
+}
+
+
+const LatencyHistogram* latency_get(int kind) {
+  return &histograms[kind];
+}
+
+
+void latency_reset(void) {
+  memset(histograms, 0, sizeof(histograms));
+}
@@ -0,0 +1,22 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+#define LATENCY_BUCKETS 101
+
+enum { LATENCY_KEY, LATENCY_TEXT, LATENCY_KINDS };
+
+typedef struct {
+  unsigned count;
+  uint32_t max;
+  double total;
+  unsigned buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+void latency_input(int kind, uint32_t timestamp);
+void latency_present(void);
+const LatencyHistogram* latency_get(int kind);
+void latency_reset(void);
+
+#endif
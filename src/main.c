@@ -2,6 +2,7 @@
 #include <SDL2/SDL.h>
 #include "api/api.h"
 #include "renderer.h"
+#include "alloc.h"
 
 #ifdef _WIN32
   #include <windows.h>
@@ -14,6 +15,18 @@
 
 SDL_Window *window;
 
+/* the time each stage of startup ended, passed to lua as STARTUP */
+static struct { const char *name; double time; } startup[4];
+static int startup_count;
+
+
+static void mark_startup(const char *name) {
+  startup[startup_count].name = name;
+  startup[startup_count].time =
+    SDL_GetPerformanceCounter() / (double) SDL_GetPerformanceFrequency();
+  startup_count++;
+}
+
 
 static double get_scale(void) {
   float dpi;
@@ -68,7 +81,12 @@ int main(int argc, char **argv) {
   SetProcessDPIAware();
 #endif
 
-  SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS);
+  /* when headless, as set by LITE_HEADLESS=<width>x<height>, everything is
+  ** drawn to an offscreen framebuffer and no window is created */
+  const char *headless = getenv("LITE_HEADLESS");
+
+  mark_startup("start");
+  SDL_Init(headless ? SDL_INIT_EVENTS : SDL_INIT_VIDEO | SDL_INIT_EVENTS);
   SDL_EnableScreenSaver();
   SDL_EventState(SDL_DROPFILE, SDL_ENABLE);
   atexit(SDL_Quit);
@@ -79,20 +97,29 @@ int main(int argc, char **argv) {
 #if SDL_VERSION_ATLEAST(2, 0, 5)
   SDL_SetHint(SDL_HINT_MOUSE_FOCUS_CLICKTHROUGH, "1");
 #endif
-
-  SDL_DisplayMode dm;
-  SDL_GetCurrentDisplayMode(0, &dm);
-
-  window = SDL_CreateWindow(
-    "", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, dm.w * 0.8, dm.h * 0.8,
-    SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_HIDDEN);
-  init_window_icon();
-  ren_init(window);
+  mark_startup("sdl init");
+
+  if (headless) {
+    int w = 1280, h = 800;
+    sscanf(headless, "%dx%d", &w, &h);
+    ren_init_headless(w > 0 ? w : 1280, h > 0 ? h : 800);
+  } else {
+    SDL_DisplayMode dm;
+    SDL_GetCurrentDisplayMode(0, &dm);
+
+    window = SDL_CreateWindow(
+      "", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, dm.w * 0.8, dm.h * 0.8,
+      SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_HIDDEN);
+    init_window_icon();
+    ren_init(window);
+  }
+  mark_startup("window");
 
 
-  lua_State *L = luaL_newstate();
+  lua_State *L = alloc_newstate();
   luaL_openlibs(L);
   api_load_libs(L);
+  mark_startup("lua state");
 
 
   lua_newtable(L);
@@ -108,14 +135,28 @@ int main(int argc, char **argv) {
   lua_pushstring(L, SDL_GetPlatform());
   lua_setglobal(L, "PLATFORM");
 
-  lua_pushnumber(L, get_scale());
+  lua_pushnumber(L, headless ? 1.0 : get_scale());
   lua_setglobal(L, "SCALE");
 
+  lua_pushboolean(L, headless != NULL);
+  lua_setglobal(L, "HEADLESS");
+
   char exename[2048];
   get_exe_filename(exename, sizeof(exename));
   lua_pushstring(L, exename);
   lua_setglobal(L, "EXEFILE");
 
+  lua_newtable(L);
+  for (int i = 0; i < startup_count; i++) {
+    lua_newtable(L);
+    lua_pushstring(L, startup[i].name);
+    lua_setfield(L, -2, "name");
+    lua_pushnumber(L, startup[i].time);
+    lua_setfield(L, -2, "time");
+    lua_rawseti(L, -2, i + 1);
+  }
+  lua_setglobal(L, "STARTUP");
+
 
   (void) luaL_dostring(L,
     "local core\n"
@@ -125,6 +166,14 @@ int main(int argc, char **argv) {
     "  EXEDIR = EXEFILE:match(\"^(.+)[/\\\\].*$\")\n"
     "  package.path = EXEDIR .. '/data/?.lua;' .. package.path\n"
     "  package.path = EXEDIR .. '/data/?/init.lua;' .. package.path\n"
+    "  require('core.startup')\n"
+    "  local bundle = require('core.bundle')\n"
+    "  if os.getenv('LITE_BUILD_BUNDLE') then\n"
+    "    local count, err = bundle.build()\n"
+    "    print(count and count .. ' modules bundled' or err)\n"
+    "    os.exit(count and 0 or 1)\n"
+    "  end\n"
+    "  bundle.install()\n"
     "  core = require('core')\n"
     "  core.init()\n"
     "  core.run()\n"
@@ -138,8 +187,8 @@ int main(int argc, char **argv) {
     "end)");
 
 
-  lua_close(L);
-  SDL_DestroyWindow(window);
+  alloc_close(L);
+  if (window) { SDL_DestroyWindow(window); }
 
   return EXIT_SUCCESS;
 }
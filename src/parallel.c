@@ -0,0 +1,98 @@
+#include <SDL2/SDL.h>
+#include "parallel.h"
+
+/* a small fork-join thread pool -- `parallel_for()` calls `fn` once for each
+** index in [0, count), spreading the calls over the worker threads and the
+** calling thread, and returns once every call has completed. Workers are
+** created on first use and live for the duration of the program. This is only
+** meant to be called from the main thread */
+
+#define MAX_WORKERS 16
+
+static SDL_mutex *mutex;
+static SDL_cond *start_cond;
+static SDL_cond *done_cond;
+static int worker_count = -1;
+static int job_id;
+static int busy;
+static SDL_atomic_t next_idx;
+
+static struct {
+  ParallelFn fn;
+  void *udata;
+  int count;
+} job;
+
+
+static void run_job(void) {
+  int idx;
+  while ( (idx = SDL_AtomicAdd(&next_idx, 1)) < job.count ) {
+    job.fn(job.udata, idx);
+  }
+}
+
+
+static int worker_main(void *udata) {
+  int seen = 0;
+  SDL_LockMutex(mutex);
+  for (;;) {
+    while (seen == job_id) {
+      SDL_CondWait(start_cond, mutex);
+    }
+    seen = job_id;
+    SDL_UnlockMutex(mutex);
+    run_job();
+    SDL_LockMutex(mutex);
+    if (--busy == 0) {
+      SDL_CondSignal(done_cond);
+    }
+  }
+  return 0;
+}
+
+
+static void init_workers(void) {
+  worker_count = 0;
+  mutex = SDL_CreateMutex();
+  start_cond = SDL_CreateCond();
+  done_cond = SDL_CreateCond();
+  if (!mutex || !start_cond || !done_cond) { return; }
+
+  int n = SDL_GetCPUCount() - 1;
+  if (n > MAX_WORKERS) { n = MAX_WORKERS; }
+  for (int i = 0; i < n; i++) {
+    SDL_Thread *thread = SDL_CreateThread(worker_main, "parallel", NULL);
+    if (!thread) { break; }
+    SDL_DetachThread(thread);
+    worker_count++;
+  }
+}
+
+
+void parallel_for(int count, ParallelFn fn, void *udata) {
+  if (worker_count < 0) { init_workers(); }
+
+  /* not worth waking the workers: run everything on this thread */
+  if (count < 2 || worker_count == 0) {
+    for (int i = 0; i < count; i++) { fn(udata, i); }
+    return;
+  }
+
+  SDL_LockMutex(mutex);
+  job.fn = fn;
+  job.udata = udata;
+  job.count = count;
+  SDL_AtomicSet(&next_idx, 0);
+  busy = worker_count;
+  job_id++;
+  SDL_CondBroadcast(start_cond);
+  SDL_UnlockMutex(mutex);
+
+  run_job();
+
+  SDL_LockMutex(mutex);
+  while (busy > 0) {
+    SDL_CondWait(done_cond, mutex);
+  }
+  SDL_UnlockMutex(mutex);
+}
@@ -0,0 +1,8 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+typedef void (*ParallelFn)(void *udata, int idx);
+
+void parallel_for(int count, ParallelFn fn, void *udata);
+
+#endif
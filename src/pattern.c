@@ -0,0 +1,272 @@
+#include <ctype.h>
+#include <stddef.h>
+#include "pattern.h"
+
+/* a matcher for lua patterns which can be used off the main thread, adapted
+** from lstrlib.c. Captures are accepted but only used for grouping, back
+** references (%0-%9) are not supported. `pattern_check()` must have accepted a
+** pattern before it is passed to `pattern_find()` or `pattern_match()` */
+
+#define L_ESC '%'
+#define MAX_DEPTH 200
+
+typedef struct {
+  const char *src_init, *src_end, *p_end;
+  int depth;
+} MatchState;
+
+static const char* match(MatchState *ms, const char *s, const char *p);
+
+
+static const char* class_end(const char *p) {
+  switch (*p++) {
+    case L_ESC:
+      return p + 1;
+    case '[':
+      if (*p == '^') { p++; }
+      do {
+        if (*(p++) == L_ESC && *p) { p++; }
+      } while (*p != ']');
+      return p + 1;
+    default:
+      return p;
+  }
+}
+
+
+static bool match_class(int c, int cl) {
+  int res;
+  switch (tolower(cl)) {
+    case 'a' : res = isalpha(c); break;
+    case 'c' : res = iscntrl(c); break;
+    case 'd' : res = isdigit(c); break;
+    case 'g' : res = isgraph(c); break;
+    case 'l' : res = islower(c); break;
+    case 'p' : res = ispunct(c); break;
+    case 's' : res = isspace(c); break;
+    case 'u' : res = isupper(c); break;
+    case 'w' : res = isalnum(c); break;
+    case 'x' : res = isxdigit(c); break;
+    case 'z' : res = (c == 0); break;
+    default  : return cl == c;
+  }
+  return islower(cl) ? res : !res;
+}
+
+
+static bool match_bracket_class(int c, const char *p, const char *ec) {
+  bool sig = true;
+  if (*(p + 1) == '^') {
+    sig = false;
+    p++;
+  }
+  while (++p < ec) {
+    if (*p == L_ESC) {
+      p++;
+      if (match_class(c, (unsigned char) *p)) { return sig; }
+    } else if (*(p + 1) == '-' && p + 2 < ec) {
+      p += 2;
+      if ((unsigned char) *(p - 2) <= c && c <= (unsigned char) *p) {
+        return sig;
+      }
+    } else if ((unsigned char) *p == c) {
+      return sig;
+    }
+  }
+  return !sig;
+}
+
+
+static bool single_match(MatchState *ms, const char *s, const char *p,
+  const char *ep
+) {
+  if (s >= ms->src_end) { return false; }
+  int c = (unsigned char) *s;
+  switch (*p) {
+    case '.'   : return true;
+    case L_ESC : return match_class(c, (unsigned char) *(p + 1));
+    case '['   : return match_bracket_class(c, p, ep - 1);
+    default    : return (unsigned char) *p == c;
+  }
+}
+
+
+static const char* match_balance(MatchState *ms, const char *s, const char *p) {
+  if (s >= ms->src_end || *s != *p) { return NULL; }
+  int b = *p, e = *(p + 1), cont = 1;
+  while (++s < ms->src_end) {
+    if (*s == e) {
+      if (--cont == 0) { return s + 1; }
+    } else if (*s == b) {
+      cont++;
+    }
+  }
+  return NULL;
+}
+
+
+static const char* max_expand(MatchState *ms, const char *s, const char *p,
+  const char *ep
+) {
+  ptrdiff_t i = 0;
+  while (single_match(ms, s + i, p, ep)) { i++; }
+  while (i >= 0) {
+    const char *res = match(ms, s + i, ep + 1);
+    if (res) { return res; }
+    i--;
+  }
+  return NULL;
+}
+
+
+static const char* min_expand(MatchState *ms, const char *s, const char *p,
+  const char *ep
+) {
+  for (;;) {
+    const char *res = match(ms, s, ep + 1);
+    if (res) { return res; }
+    if (!single_match(ms, s, p, ep)) { return NULL; }
+    s++;
+  }
+}
+
+
+static const char* match(MatchState *ms, const char *s, const char *p) {
+  if (ms->depth-- == 0) { return NULL; }
+init:
+  if (p != ms->p_end) {
+    switch (*p) {
+      case '(':
+      case ')':
+        p++;
+        goto init;
+      case '$':
+        if (p + 1 != ms->p_end) { goto dflt; }
+        s = (s == ms->src_end) ? s : NULL;
+        break;
+      case L_ESC:
+        if (*(p + 1) == 'b') {
+          s = match_balance(ms, s, p + 2);
+          if (s) { p += 4; goto init; }
+          break;
+        }
+        if (*(p + 1) == 'f') {
+          p += 2;
+          const char *ep = class_end(p);
+          char previous = (s == ms->src_init) ? '\0' : *(s - 1);
+          char current = (s == ms->src_end) ? '\0' : *s;
+          if (!match_bracket_class((unsigned char) previous, p, ep - 1) &&
+              match_bracket_class((unsigned char) current, p, ep - 1)) {
+            p = ep; goto init;
+          }
+          s = NULL;
+          break;
+        }
+        goto dflt;
+      default: dflt: {
+        const char *ep = class_end(p);
+        if (!single_match(ms, s, p, ep)) {
+          if (*ep == '*' || *ep == '?' || *ep == '-') {
+            p = ep + 1; goto init;
+          }
+          s = NULL;
+        } else {
+          switch (*ep) {
+            case '?': {
+              const char *res = match(ms, s + 1, ep + 1);
+              if (res) {
+                s = res;
+              } else {
+                p = ep + 1; goto init;
+              }
+              break;
+            }
+            case '+':
+              s++;
+              /* fallthrough */
+            case '*':
+              s = max_expand(ms, s, p, ep);
+              break;
+            case '-':
+              s = min_expand(ms, s, p, ep);
+              break;
+            default:
+              s++; p = ep; goto init;
+          }
+        }
+        break;
+      }
+    }
+  }
+  ms->depth++;
+  return s;
+}
+
+
+const char* pattern_check(const char *p) {
+  if (*p == '^') { p++; }
+  while (*p) {
+    if (*p == L_ESC) {
+      char c = *(p + 1);
+      if (c == '\0') { return "malformed pattern (ends with '%')"; }
+      if (isdigit((unsigned char) c)) { return "back references are not supported"; }
+      if (c == 'b') {
+        if (!*(p + 2) || !*(p + 3)) { return "missing arguments to '%b'"; }
+        p += 4;
+        continue;
+      }
+      if (c == 'f') {
+        p += 2;
+        if (*p != '[') { return "missing '[' after '%f' in pattern"; }
+      }
+    }
+    if (*p == '[') {
+      const char *q = p + 1;
+      if (*q == '^') { q++; }
+      do {
+        if (!*q) { return "malformed pattern (missing ']')"; }
+        if (*(q++) == L_ESC && *q) { q++; }
+      } while (*q != ']');
+      p = q + 1;
+      continue;
+    }
+    p = class_end(p);
+  }
+  return NULL;
+}
+
+
+bool pattern_find(const char *s, const char *p) {
+  const char *s_end = s;
+  while (*s_end) { s_end++; }
+  size_t start, end;
+  return pattern_match(s, s_end - s, 0, p, &start, &end);
+}
+
+
+/* finds the first match in `s` starting at or after `init`, like
+** `string.find(s, p, init + 1)`, and sets the match's [start, end) offsets */
+bool pattern_match(const char *s, size_t len, size_t init, const char *p,
+  size_t *start, size_t *end)
+{
+  MatchState ms;
+  const char *p_end = p;
+  while (*p_end) { p_end++; }
+
+  bool anchor = (*p == '^');
+  if (anchor) { p++; }
+  ms.src_init = s;
+  ms.src_end = s + len;
+  ms.p_end = p_end;
+  const char *s1 = s + init;
+  do {
+    ms.depth = MAX_DEPTH;
+    const char *e = match(&ms, s1, p);
+    if (e) {
+      *start = s1 - s;
+      *end = e - s;
+      return true;
+    }
+  } while (s1++ < ms.src_end && !anchor);
+  return false;
+}
@@ -0,0 +1,12 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+const char* pattern_check(const char *p);
+bool pattern_find(const char *s, const char *p);
+bool pattern_match(const char *s, size_t len, size_t init, const char *p,
+  size_t *start, size_t *end);
+
+#endif
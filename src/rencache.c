@@ -1,5 +1,7 @@
 #include <stdio.h>
+#include <SDL2/SDL.h>
 #include "rencache.h"
+#include "trace.h"
 
 /* a cache over the software renderer -- all drawing operations are stored as
 ** commands when issued. At the end of the frame we write the commands to a grid
@@ -32,11 +34,17 @@ static char command_buf[COMMAND_BUF_SIZE];
 static int command_buf_idx;
 static RenRect screen_rect;
 static bool show_debug;
+static RenCacheStats stats;
 
 
 static inline int min(int a, int b) { return a < b ? a : b; }
 static inline int max(int a, int b) { return a > b ? a : b; }
 
+static double get_time(void) {
+  return SDL_GetPerformanceCounter() / (double) SDL_GetPerformanceFrequency();
+}
+
+
 /* 32bit fnv-1a hash */
 #define HASH_INITIAL 2166136261
 
@@ -200,9 +208,13 @@ static void push_rect(RenRect r, int *count) {
 
 void rencache_end_frame(void) {
   /* update cells from commands */
+  double start = get_time();
+  trace_begin("render", "hash");
   Command *cmd = NULL;
   RenRect cr = screen_rect;
+  stats.commands = 0;
   while (next_command(&cmd)) {
+    stats.commands++;
     if (cmd->type == SET_CLIP) { cr = cmd->rect; }
     RenRect r = intersect_rects(cmd->rect, cr);
     if (r.width == 0 || r.height == 0) { continue; }
@@ -237,6 +249,9 @@ void rencache_end_frame(void) {
   }
 
   /* redraw updated regions */
+  double hashed = get_time();
+  trace_end();
+  trace_begin("render", "rasterize");
   bool has_free_commands = false;
   for (int i = 0; i < rect_count; i++) {
     /* draw */
@@ -269,9 +284,17 @@ void rencache_end_frame(void) {
   }
 
   /* update dirty rects */
+  double drawn = get_time();
+  trace_end();
+  trace_begin("render", "present");
   if (rect_count > 0) {
     ren_update_rects(rect_buf, rect_count);
   }
+  trace_end();
+  stats.hash_time = hashed - start;
+  stats.draw_time = drawn - hashed;
+  stats.present_time = get_time() - drawn;
+  stats.rects = rect_count;
 
   /* free fonts */
   if (has_free_commands) {
@@ -289,3 +312,9 @@ void rencache_end_frame(void) {
   cells_prev = tmp;
   command_buf_idx = 0;
 }
+
+
+/* returns the timings, in seconds, and counts of the last frame */
+void rencache_get_stats(RenCacheStats *res) {
+  *res = stats;
+}
@@ -4,6 +4,11 @@
 #include <stdbool.h>
 #include "renderer.h"
 
+typedef struct {
+  double hash_time, draw_time, present_time;
+  int commands, rects;
+} RenCacheStats;
+
 void rencache_show_debug(bool enable);
 void rencache_free_font(RenFont *font);
 void rencache_set_clip_rect(RenRect rect);
@@ -12,5 +17,6 @@ int  rencache_draw_text(RenFont *font, const char *text, int x, int y, RenColor
 void rencache_invalidate(void);
 void rencache_begin_frame(void);
 void rencache_end_frame(void);
+void rencache_get_stats(RenCacheStats *stats);
 
 #endif
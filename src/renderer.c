@@ -1,15 +1,26 @@
 #include <stdio.h>
+#include <string.h>
 #include <stdbool.h>
 #include <assert.h>
 #include <math.h>
 #include "lib/stb/stb_truetype.h"
 #include "renderer.h"
+#include "trace.h"
+
+#ifndef _WIN32
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
 
 #define MAX_GLYPHSET 256
 
 struct RenImage {
   RenColor *pixels;
   int width, height;
+  void *mapping;
+  size_t mapping_size;
 };
 
 typedef struct {
@@ -19,6 +30,7 @@ typedef struct {
 
 struct RenFont {
   void *data;
+  uint64_t hash;
   stbtt_fontinfo stbfont;
   GlyphSet *sets[MAX_GLYPHSET];
   float size;
@@ -27,7 +39,9 @@ struct RenFont {
 
 
 static SDL_Window *window;
+static RenImage *offscreen;
 static struct { int left, top, right, bottom; } clip;
+static char glyph_cache_dir[1024];
 
 
 static void* check_alloc(void *ptr) {
@@ -56,6 +70,19 @@ static const char* utf8_to_codepoint(const char *p, unsigned *dst) {
 }
 
 
+/* returns the image being drawn to: the offscreen framebuffer when headless,
+** otherwise the window's surface */
+static RenImage* get_target(void) {
+  static RenImage surface;
+  if (offscreen) { return offscreen; }
+  SDL_Surface *surf = SDL_GetWindowSurface(window);
+  surface.pixels = surf->pixels;
+  surface.width = surf->w;
+  surface.height = surf->h;
+  return &surface;
+}
+
+
 void ren_init(SDL_Window *win) {
   assert(win);
   window = win;
@@ -64,7 +91,15 @@ void ren_init(SDL_Window *win) {
 }
 
 
+void ren_init_headless(int width, int height) {
+  offscreen = ren_new_image(width, height);
+  memset(offscreen->pixels, 0, width * height * sizeof(RenColor));
+  ren_set_clip_rect( (RenRect) { 0, 0, width, height } );
+}
+
+
 void ren_update_rects(RenRect *rects, int count) {
+  if (offscreen) { return; }
   SDL_UpdateWindowSurfaceRects(window, (SDL_Rect*) rects, count);
   static bool initial_frame = true;
   if (initial_frame) {
@@ -83,9 +118,48 @@ void ren_set_clip_rect(RenRect rect) {
 
 
 void ren_get_size(int *x, int *y) {
-  SDL_Surface *surf = SDL_GetWindowSurface(window);
-  *x = surf->w;
-  *y = surf->h;
+  RenImage *target = get_target();
+  *x = target->width;
+  *y = target->height;
+}
+
+
+int ren_save_frame(const char *filename) {
+  RenImage *target = get_target();
+  FILE *fp = fopen(filename, "wb");
+  if (!fp) { return -1; }
+  fprintf(fp, "P6\n%d %d\n255\n", target->width, target->height);
+  int n = target->width * target->height;
+  for (int i = 0; i < n; i++) {
+    RenColor c = target->pixels[i];
+    fputc(c.r, fp);
+    fputc(c.g, fp);
+    fputc(c.b, fp);
+  }
+  return fclose(fp);
+}
+
+
+int ren_compare_frame(const char *filename) {
+  RenImage *target = get_target();
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) { return -1; }
+  int w, h, max;
+  if (fscanf(fp, "P6 %d %d %d", &w, &h, &max) != 3 || fgetc(fp) == EOF
+    || w != target->width || h != target->height || max != 255
+  ) {
+    fclose(fp);
+    return -2;
+  }
+  int n = w * h, diff = 0;
+  for (int i = 0; i < n; i++) {
+    RenColor c = target->pixels[i];
+    int r = fgetc(fp), g = fgetc(fp), b = fgetc(fp);
+    if (b == EOF) { diff += n - i; break; }
+    diff += (r != c.r || g != c.g || b != c.b);
+  }
+  fclose(fp);
+  return diff;
 }
 
 
@@ -96,17 +170,146 @@ RenImage* ren_new_image(int width, int height) {
   image->pixels = (void*) (image + 1);
   image->width = width;
   image->height = height;
+  image->mapping = NULL;
   return image;
 }
 
 
 void ren_free_image(RenImage *image) {
+#ifndef _WIN32
+  if (image->mapping) { munmap(image->mapping, image->mapping_size); }
+#endif
   free(image);
 }
 
 
+/* baked glyphsets are cached on disk across launches, each in a file of its
+** own keyed by the font's hash, size and the set's index. A file holds this
+** header followed by the set's image in the renderer's own pixel format, so
+** that it can be mapped into memory and drawn from as it is */
+typedef struct {
+  char magic[8];
+  uint64_t font_hash;
+  float size;
+  int idx, width, height;
+  stbtt_bakedchar glyphs[256];
+} GlyphCacheHeader;
+
+static const char glyph_cache_magic[8] = "LITEGC1";
+
+
+void ren_set_glyph_cache(const char *dir) {
+  snprintf(glyph_cache_dir, sizeof(glyph_cache_dir), "%s", dir ? dir : "");
+}
+
+
+static uint64_t hash_data(const void *data, size_t size) {
+  const unsigned char *p = data;
+  uint64_t h = 14695981039346656037ULL;
+  while (size--) { h = (h ^ *p++) * 1099511628211ULL; }
+  return h;
+}
+
+
+static void get_glyph_cache_filename(char *buf, int sz, RenFont *font, int idx) {
+  uint32_t size;
+  memcpy(&size, &font->size, sizeof(size));
+  snprintf(buf, sz, "%s/glyphs_%016llx_%08x_%02x", glyph_cache_dir,
+    (unsigned long long) font->hash, size, idx);
+}
+
+
+static bool check_glyph_cache_header(GlyphCacheHeader *h, RenFont *font,
+  int idx, size_t file_size
+) {
+  return memcmp(h->magic, glyph_cache_magic, sizeof(h->magic)) == 0
+    && h->font_hash == font->hash && h->size == font->size && h->idx == idx
+    && h->width > 0 && h->height > 0
+    && file_size == sizeof(*h) + (size_t) h->width * h->height * sizeof(RenColor);
+}
+
+
+static bool load_cached_glyphset(RenFont *font, int idx, GlyphSet *set) {
+  if (!*glyph_cache_dir) { return false; }
+  char filename[1100];
+  get_glyph_cache_filename(filename, sizeof(filename), font, idx);
+
+#ifdef _WIN32
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) { return false; }
+  GlyphCacheHeader h;
+  fseek(fp, 0, SEEK_END); size_t size = ftell(fp); fseek(fp, 0, SEEK_SET);
+  bool ok = fread(&h, sizeof(h), 1, fp) == 1
+    && check_glyph_cache_header(&h, font, idx, size);
+  if (ok) {
+    set->image = ren_new_image(h.width, h.height);
+    ok = fread(set->image->pixels, sizeof(RenColor) * h.width, h.height, fp)
+      == (size_t) h.height;
+    if (!ok) { ren_free_image(set->image); }
+  }
+  fclose(fp);
+  if (!ok) { return false; }
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) { return false; }
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t) st.st_size > sizeof(GlyphCacheHeader)) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) { return false; }
+  GlyphCacheHeader h;
+  memcpy(&h, map, sizeof(h));
+  if (!check_glyph_cache_header(&h, font, idx, st.st_size)) {
+    munmap(map, st.st_size);
+    return false;
+  }
+  /* the image's pixels are left in the mapping, only its header is allocated */
+  set->image = check_alloc(malloc(sizeof(RenImage)));
+  set->image->pixels = (void*) ((char*) map + sizeof(h));
+  set->image->width = h.width;
+  set->image->height = h.height;
+  set->image->mapping = map;
+  set->image->mapping_size = st.st_size;
+#endif
+
+  memcpy(set->glyphs, h.glyphs, sizeof(set->glyphs));
+  return true;
+}
+
+
+static void save_cached_glyphset(RenFont *font, int idx, GlyphSet *set) {
+  if (!*glyph_cache_dir) { return; }
+  char filename[1100], temp[1200];
+  get_glyph_cache_filename(filename, sizeof(filename), font, idx);
+  snprintf(temp, sizeof(temp), "%s.%llx.tmp", filename,
+    (unsigned long long) SDL_GetPerformanceCounter());
+
+  GlyphCacheHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, glyph_cache_magic, sizeof(h.magic));
+  h.font_hash = font->hash;
+  h.size = font->size;
+  h.idx = idx;
+  h.width = set->image->width;
+  h.height = set->image->height;
+  memcpy(h.glyphs, set->glyphs, sizeof(h.glyphs));
+
+  FILE *fp = fopen(temp, "wb");
+  if (!fp) { return; }
+  bool ok = fwrite(&h, sizeof(h), 1, fp) == 1
+    && fwrite(set->image->pixels, sizeof(RenColor) * h.width, h.height, fp)
+      == (size_t) h.height;
+  if (fclose(fp) != 0 || !ok || rename(temp, filename) != 0) {
+    remove(temp);
+  }
+}
+
+
 static GlyphSet* load_glyphset(RenFont *font, int idx) {
   GlyphSet *set = check_alloc(calloc(1, sizeof(GlyphSet)));
+  if (load_cached_glyphset(font, idx, set)) { return set; }
 
   /* init image */
   int width = 128;
@@ -146,6 +349,7 @@ retry:
     set->image->pixels[i] = (RenColor) { .r = 255, .g = 255, .b = 255, .a = n };
   }
 
+  save_cached_glyphset(font, idx, set);
   return set;
 }
 
@@ -153,7 +357,9 @@ retry:
 static GlyphSet* get_glyphset(RenFont *font, int codepoint) {
   int idx = (codepoint >> 8) % MAX_GLYPHSET;
   if (!font->sets[idx]) {
+    trace_begin("render", "load_glyphset");
     font->sets[idx] = load_glyphset(font, idx);
+    trace_end();
   }
   return font->sets[idx];
 }
@@ -177,6 +383,7 @@ RenFont* ren_load_font(const char *filename, float size) {
   int _ = fread(font->data, 1, buf_size, fp); (void) _;
   fclose(fp);
   fp = NULL;
+  font->hash = hash_data(font->data, buf_size);
 
   /* init stbfont */
   int ok = stbtt_InitFont(&font->stbfont, font->data, 0);
@@ -285,10 +492,10 @@ void ren_draw_rect(RenRect rect, RenColor color) {
   x2 = x2 > clip.right  ? clip.right  : x2;
   y2 = y2 > clip.bottom ? clip.bottom : y2;
 
-  SDL_Surface *surf = SDL_GetWindowSurface(window);
-  RenColor *d = (RenColor*) surf->pixels;
-  d += x1 + y1 * surf->w;
-  int dr = surf->w - (x2 - x1);
+  RenImage *target = get_target();
+  RenColor *d = target->pixels;
+  d += x1 + y1 * target->width;
+  int dr = target->width - (x2 - x1);
 
   if (color.a == 0xff) {
     rect_draw_loop(color);
@@ -313,13 +520,13 @@ void ren_draw_image(RenImage *image, RenRect *sub, int x, int y, RenColor color)
   }
 
   /* draw */
-  SDL_Surface *surf = SDL_GetWindowSurface(window);
+  RenImage *target = get_target();
   RenColor *s = image->pixels;
-  RenColor *d = (RenColor*) surf->pixels;
+  RenColor *d = target->pixels;
   s += sub->x + sub->y * image->width;
-  d += x + y * surf->w;
+  d += x + y * target->width;
   int sr = image->width - sub->width;
-  int dr = surf->w - sub->width;
+  int dr = target->width - sub->width;
 
   for (int j = 0; j < sub->height; j++) {
     for (int i = 0; i < sub->width; i++) {
@@ -12,13 +12,17 @@ typedef struct { int x, y, width, height; } RenRect;
 
 
 void ren_init(SDL_Window *win);
+void ren_init_headless(int width, int height);
 void ren_update_rects(RenRect *rects, int count);
 void ren_set_clip_rect(RenRect rect);
 void ren_get_size(int *x, int *y);
+int ren_save_frame(const char *filename);
+int ren_compare_frame(const char *filename);
 
 RenImage* ren_new_image(int width, int height);
 void ren_free_image(RenImage *image);
 
+void ren_set_glyph_cache(const char *dir);
 RenFont* ren_load_font(const char *filename, float size);
 void ren_free_font(RenFont *font);
 void ren_set_font_tab_width(RenFont *font, int n);
@@ -0,0 +1,343 @@
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef __linux__
+  #include <unistd.h>
+  #include <sys/inotify.h>
+#endif
+#include "scan.h"
+#include "pattern.h"
+#include "ignore.h"
+
+/* recursively lists a directory on a set of worker threads -- each worker
+** takes a directory from the queue, lists and stats its entries, sorts them
+** (directories first, then by name) and queues its subdirectories. Entries
+** whose name matches one of the ignore patterns, or whose size is not below
+** the size limit, are skipped and ignored directories are never opened. With
+** `use_ignore_files` set the .gitignore and .ignore files of each directory
+** (and, for a relative path, of its parents) are applied as well. With a
+** `watch_fd` of a directory monitor each directory is watched right before it
+** is listed, so nothing created after it was listed is missed. Once done
+** `scan_entries()` returns all entries in depth-first order, which is the
+** order of `core.project_files` */
+
+#define MAX_WORKERS 8
+#define MAX_DEPTH 64
+
+#ifdef __linux__
+/* the events watched for by the directory monitor */
+#define WATCH_MASK \
+  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | \
+   IN_ONLYDIR)
+#endif
+
+#ifdef _WIN32
+  #define PATHSEP '\\'
+#else
+  #define PATHSEP '/'
+#endif
+
+struct ScanDir {
+  char *path;
+  int depth;
+  dev_t dev;
+  ino_t ino;
+  ScanDir *parent;
+  IgnoreList *ignore;
+  ScanEntry *entries;
+  int count;
+  ScanDir *next;
+};
+
+struct Scan {
+  SDL_mutex *mutex;
+  SDL_cond *cond;
+  ScanOptions opt;
+  IgnoreList *ignore;
+  ScanDir *root;
+  ScanDir *queue;
+  int active, threads;
+  bool cancelled, released;
+  ScanEntry **list;
+  int list_count;
+};
+
+
+static void* check_alloc(void *ptr) {
+  if (!ptr) {
+    fprintf(stderr, "Fatal error: memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+
+static bool is_dir(const ScanEntry *e) {
+  return e->type && strcmp(e->type, "dir") == 0;
+}
+
+
+static char* join_path(const char *dir, const char *name) {
+  if (strcmp(dir, ".") == 0) { return strdup(name); }
+  size_t n = strlen(dir);
+  char *res = malloc(n + strlen(name) + 2);
+  if (!res) { return NULL; }
+  memcpy(res, dir, n);
+  res[n] = PATHSEP;
+  strcpy(res + n + 1, name);
+  return res;
+}
+
+
+static ScanDir* new_dir(char *path, ScanDir *parent, struct stat *s) {
+  ScanDir *d = calloc(1, sizeof(ScanDir));
+  if (!d) { return NULL; }
+  d->path = path;
+  d->parent = parent;
+  d->depth = parent ? parent->depth + 1 : 0;
+  d->dev = s->st_dev;
+  d->ino = s->st_ino;
+  return d;
+}
+
+
+/* a symlink back to one of its own parents would otherwise be walked until the
+** depth limit is hit */
+static bool is_cycle(ScanDir *d) {
+#ifdef _WIN32
+  return false;
+#else
+  for (ScanDir *p = d->parent; p; p = p->parent) {
+    if (p->dev == d->dev && p->ino == d->ino) { return true; }
+  }
+  return false;
+#endif
+}
+
+
+static void free_dir(ScanDir *d) {
+  for (int i = 0; i < d->count; i++) {
+    if (d->entries[i].dir) { free_dir(d->entries[i].dir); }
+    free(d->entries[i].filename);
+  }
+  free(d->entries);
+  free(d->path);
+  ignore_release(d->ignore);
+  free(d);
+}
+
+
+static bool is_ignored(const ScanOptions *opt, const char *name) {
+  for (int i = 0; i < opt->ignore_count; i++) {
+    if (pattern_find(name, opt->ignore[i])) { return true; }
+  }
+  return false;
+}
+
+
+static int compare_entries(const void *a, const void *b) {
+  const ScanEntry *x = a, *y = b;
+  if (is_dir(x) != is_dir(y)) { return is_dir(x) ? -1 : 1; }
+  return strcmp(x->filename, y->filename);
+}
+
+
+static void read_dir(Scan *scan, ScanDir *d) {
+#ifdef __linux__
+  if (scan->opt.watch_fd >= 0) {
+    inotify_add_watch(scan->opt.watch_fd, d->path, WATCH_MASK);
+  }
+#endif
+  DIR *dir = opendir(d->path);
+  if (!dir) { return; }
+
+  if (scan->opt.use_ignore_files) {
+    IgnoreList *parent = d->parent ? d->parent->ignore : scan->ignore;
+    d->ignore = ignore_load_dir(parent, d->path);
+  }
+
+  int capacity = 0;
+  struct dirent *e;
+  while ( (e = readdir(dir)) ) {
+    if (strcmp(e->d_name, "." ) == 0) { continue; }
+    if (strcmp(e->d_name, "..") == 0) { continue; }
+    if (is_ignored(&scan->opt, e->d_name)) { continue; }
+
+    /* size and modified time are needed for every entry: stat relative to the
+    ** open directory where possible to skip the full path lookup */
+    char *filename = join_path(d->path, e->d_name);
+    if (!filename) { continue; }
+    struct stat s;
+#ifdef _WIN32
+    int err = stat(filename, &s);
+#else
+    int err = fstatat(dirfd(dir), e->d_name, &s, 0);
+#endif
+    if (err < 0 || s.st_size >= scan->opt.size_limit
+    || ignore_match(d->ignore, filename, S_ISDIR(s.st_mode))) {
+      free(filename);
+      continue;
+    }
+
+    if (d->count == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      ScanEntry *p = realloc(d->entries, capacity * sizeof(ScanEntry));
+      if (!p) { free(filename); break; }
+      d->entries = p;
+    }
+    ScanEntry *entry = &d->entries[d->count++];
+    entry->filename = filename;
+    entry->modified = s.st_mtime;
+    entry->size = s.st_size;
+    entry->dir = NULL;
+    entry->type = S_ISREG(s.st_mode) ? "file" : S_ISDIR(s.st_mode) ? "dir" : NULL;
+    if (S_ISDIR(s.st_mode)) {
+      /* sub directories are listed even past the depth limit or if they are a
+      ** link to a parent, but not read */
+      entry->dir = new_dir(strdup(filename), d, &s);
+    }
+  }
+  closedir(dir);
+
+  qsort(d->entries, d->count, sizeof(ScanEntry), compare_entries);
+}
+
+
+static void destroy(Scan *scan) {
+  if (scan->root) { free_dir(scan->root); }
+  for (int i = 0; i < scan->opt.ignore_count; i++) {
+    free((char*) scan->opt.ignore[i]);
+  }
+  free(scan->opt.ignore);
+#ifdef __linux__
+  if (scan->opt.watch_fd >= 0) { close(scan->opt.watch_fd); }
+#endif
+  ignore_release(scan->ignore);
+  free(scan->list);
+  SDL_DestroyCond(scan->cond);
+  SDL_DestroyMutex(scan->mutex);
+  free(scan);
+}
+
+
+static int worker_main(void *udata) {
+  Scan *scan = udata;
+  SDL_LockMutex(scan->mutex);
+  for (;;) {
+    while (!scan->queue && scan->active > 0 && !scan->cancelled) {
+      SDL_CondWait(scan->cond, scan->mutex);
+    }
+    if (!scan->queue || scan->cancelled) { break; }
+
+    ScanDir *d = scan->queue;
+    scan->queue = d->next;
+    scan->active++;
+    SDL_UnlockMutex(scan->mutex);
+
+    read_dir(scan, d);
+
+    SDL_LockMutex(scan->mutex);
+    for (int i = 0; i < d->count; i++) {
+      ScanDir *child = d->entries[i].dir;
+      if (child && child->depth < MAX_DEPTH && !is_cycle(child)) {
+        child->next = scan->queue;
+        scan->queue = child;
+      }
+    }
+    scan->active--;
+    SDL_CondBroadcast(scan->cond);
+  }
+
+  /* last worker out frees the scan if it was released while running */
+  bool free_scan = --scan->threads == 0 && scan->released;
+  SDL_CondBroadcast(scan->cond);
+  SDL_UnlockMutex(scan->mutex);
+  if (free_scan) { destroy(scan); }
+  return 0;
+}
+
+
+Scan* scan_start(const char *path, const ScanOptions *opt) {
+  Scan *scan = calloc(1, sizeof(Scan));
+  if (!scan) { return NULL; }
+  scan->opt.size_limit = opt->size_limit;
+  scan->opt.use_ignore_files = opt->use_ignore_files;
+  /* the scan keeps its own descriptor, as it may outlive the monitor's */
+  scan->opt.watch_fd = -1;
+#ifdef __linux__
+  if (opt->watch_fd >= 0) { scan->opt.watch_fd = dup(opt->watch_fd); }
+#endif
+  if (opt->use_ignore_files) { scan->ignore = ignore_load_path(path); }
+  scan->opt.ignore = calloc(opt->ignore_count + 1, sizeof(char*));
+  for (int i = 0; i < opt->ignore_count; i++) {
+    scan->opt.ignore[scan->opt.ignore_count++] = strdup(opt->ignore[i]);
+  }
+  scan->mutex = SDL_CreateMutex();
+  scan->cond = SDL_CreateCond();
+  struct stat s;
+  if (stat(path, &s) < 0) { memset(&s, 0, sizeof(s)); }
+  scan->root = new_dir(strdup(path), NULL, &s);
+  scan->queue = scan->root;
+
+  int n = SDL_GetCPUCount();
+  if (n > MAX_WORKERS) { n = MAX_WORKERS; }
+  SDL_LockMutex(scan->mutex);
+  for (int i = 0; i < n; i++) {
+    SDL_Thread *thread = SDL_CreateThread(worker_main, "scan", scan);
+    if (!thread) { break; }
+    SDL_DetachThread(thread);
+    scan->threads++;
+  }
+  SDL_UnlockMutex(scan->mutex);
+
+  /* couldn't start any threads: do the scan on this thread instead */
+  if (scan->threads == 0) {
+    scan->threads = 1;
+    worker_main(scan);
+  }
+  return scan;
+}
+
+
+bool scan_done(Scan *scan) {
+  SDL_LockMutex(scan->mutex);
+  bool res = scan->threads == 0;
+  SDL_UnlockMutex(scan->mutex);
+  return res;
+}
+
+
+static void flatten(Scan *scan, ScanDir *d, int *capacity) {
+  for (int i = 0; i < d->count; i++) {
+    if (scan->list_count == *capacity) {
+      *capacity = *capacity ? *capacity * 2 : 256;
+      scan->list = check_alloc(realloc(scan->list, *capacity * sizeof(ScanEntry*)));
+    }
+    scan->list[scan->list_count++] = &d->entries[i];
+    if (d->entries[i].dir) { flatten(scan, d->entries[i].dir, capacity); }
+  }
+}
+
+
+ScanEntry** scan_entries(Scan *scan, int *count) {
+  if (!scan->list) {
+    int capacity = 0;
+    flatten(scan, scan->root, &capacity);
+  }
+  *count = scan->list_count;
+  return scan->list;
+}
+
+
+void scan_free(Scan *scan) {
+  SDL_LockMutex(scan->mutex);
+  scan->cancelled = true;
+  scan->released = true;
+  bool running = scan->threads > 0;
+  SDL_CondBroadcast(scan->cond);
+  SDL_UnlockMutex(scan->mutex);
+  if (!running) { destroy(scan); }
+}
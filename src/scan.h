@@ -0,0 +1,29 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+
+typedef struct Scan Scan;
+typedef struct ScanDir ScanDir;
+
+typedef struct {
+  char *filename;
+  const char *type;
+  double modified, size;
+  ScanDir *dir;
+} ScanEntry;
+
+typedef struct {
+  const char **ignore;
+  int ignore_count;
+  double size_limit;
+  bool use_ignore_files;
+  int watch_fd;
+} ScanOptions;
+
+Scan* scan_start(const char *path, const ScanOptions *opt);
+bool scan_done(Scan *scan);
+ScanEntry** scan_entries(Scan *scan, int *count);
+void scan_free(Scan *scan);
+
+#endif
@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "symbols.h"
+#include "pattern.h"
+#include "fuzzy.h"
+
+/* an index of the symbols found in a number of documents -- each document
+** keeps the symbols of each of its lines, found by matching the index's
+** pattern, and each symbol counts the occurrences referencing it, so that a
+** changed line only needs its old symbols released and its new ones found.
+** The index keeps its symbols in a hash table for lookups and in a sorted
+** array for prefix queries; new symbols are first inserted into a small
+** sorted array of recent symbols, which is merged into the large one once
+** full. A symbol whose last occurrence is released is kept as a dead symbol,
+** which is skipped by queries and revived if it occurs again, so that typing
+** a word doesn't add and remove its prefixes over and over; dead symbols are
+** only freed once there are more of them than there are live ones. Fuzzy
+** queries use a FuzzySet built the first time one is made, which is then
+** updated as symbols are added, killed and revived. The index is freed once it
+** and all its documents have been released */
+
+#define RECENT_MAX 256
+
+typedef struct Symbol Symbol;
+
+struct Symbol {
+  Symbol *next;
+  unsigned hash;
+  int refs;
+  int fuzzy_idx;
+  size_t len;
+  char text[];
+};
+
+typedef struct {
+  Symbol **syms;
+  int count;
+} SymbolLine;
+
+struct SymbolIndex {
+  char *pattern;
+  int refs;
+  Symbol **buckets;
+  int bucket_count;
+  Symbol **sorted;
+  int count, capacity;
+  Symbol *recent[RECENT_MAX];
+  int recent_count;
+  int total, dead;
+  FuzzySet *fuzzy;
+  Symbol **fuzzy_syms;
+  int fuzzy_capacity;
+  const char **res;
+};
+
+struct SymbolDoc {
+  SymbolIndex *index;
+  SymbolLine *lines;
+  int count, capacity;
+};
+
+
+static void* check_alloc(void *ptr) {
+  if (!ptr) {
+    fprintf(stderr, "Fatal error: memory allocation failed\n");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+
+static unsigned hash_string(const char *s, size_t len) {
+  unsigned h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ (unsigned char) s[i]) * 16777619u;
+  }
+  return h;
+}
+
+
+static int compare(const char *a, size_t a_len, const char *b, size_t b_len) {
+  int res = memcmp(a, b, a_len < b_len ? a_len : b_len);
+  return res ? res : (a_len > b_len) - (a_len < b_len);
+}
+
+
+/* returns the position of the first of the `n` sorted symbols which is not
+** less than `s` */
+static int lower_bound(Symbol **syms, int n, const char *s, size_t len) {
+  int lo = 0, hi = n;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    Symbol *sym = syms[mid];
+    if (compare(sym->text, sym->len, s, len) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+
+static void free_fuzzy(SymbolIndex *index) {
+  if (index->fuzzy) {
+    fuzzy_free(index->fuzzy);
+    index->fuzzy = NULL;
+  }
+}
+
+
+static void add_fuzzy(SymbolIndex *index, Symbol *sym) {
+  int idx = fuzzy_add(index->fuzzy, sym->text, sym->len);
+  if (idx < 0) {
+    /* rebuilt on the next query */
+    free_fuzzy(index);
+    return;
+  }
+  if (idx == index->fuzzy_capacity) {
+    index->fuzzy_capacity *= 2;
+    index->fuzzy_syms = check_alloc(realloc(index->fuzzy_syms,
+      index->fuzzy_capacity * sizeof(*index->fuzzy_syms)));
+  }
+  index->fuzzy_syms[idx] = sym;
+  sym->fuzzy_idx = idx;
+}
+
+
+static void grow(SymbolIndex *index) {
+  index->capacity = index->capacity ? index->capacity * 2 : 256;
+  index->sorted = check_alloc(realloc(index->sorted,
+    index->capacity * sizeof(*index->sorted)));
+  index->res = check_alloc(realloc(index->res,
+    index->capacity * sizeof(*index->res)));
+
+  /* rehash into a table as large as the new capacity */
+  free(index->buckets);
+  index->bucket_count = index->capacity;
+  index->buckets = check_alloc(calloc(index->bucket_count, sizeof(Symbol*)));
+  for (int i = 0; i < index->count + index->recent_count; i++) {
+    Symbol *sym = i < index->count
+      ? index->sorted[i] : index->recent[i - index->count];
+    Symbol **bucket = &index->buckets[sym->hash & (index->bucket_count - 1)];
+    sym->next = *bucket;
+    *bucket = sym;
+  }
+}
+
+
+/* merges the recent symbols into the sorted array, which always has room for
+** them, from the back */
+static void merge_recent(SymbolIndex *index) {
+  int i = index->count - 1, j = index->recent_count - 1;
+  int k = index->count + index->recent_count - 1;
+  while (j >= 0) {
+    Symbol *a = i >= 0 ? index->sorted[i] : NULL;
+    Symbol *b = index->recent[j];
+    if (a && compare(a->text, a->len, b->text, b->len) > 0) {
+      index->sorted[k--] = index->sorted[i--];
+    } else {
+      index->sorted[k--] = index->recent[j--];
+    }
+  }
+  index->count += index->recent_count;
+  index->recent_count = 0;
+}
+
+
+/* frees the dead symbols, along with the FuzzySet still holding them */
+static void purge(SymbolIndex *index) {
+  merge_recent(index);
+  int n = 0;
+  for (int i = 0; i < index->count; i++) {
+    Symbol *sym = index->sorted[i];
+    if (sym->refs > 0) {
+      index->sorted[n++] = sym;
+      continue;
+    }
+    Symbol **p = &index->buckets[sym->hash & (index->bucket_count - 1)];
+    while (*p != sym) { p = &(*p)->next; }
+    *p = sym->next;
+    free(sym);
+  }
+  index->count = index->total = n;
+  index->dead = 0;
+  free_fuzzy(index);
+}
+
+
+static Symbol* retain_symbol(SymbolIndex *index, const char *s, size_t len) {
+  unsigned h = hash_string(s, len);
+  Symbol **bucket = &index->buckets[h & (index->bucket_count - 1)];
+  for (Symbol *sym = *bucket; sym; sym = sym->next) {
+    if (sym->hash == h && sym->len == len && memcmp(sym->text, s, len) == 0) {
+      if (sym->refs++ == 0) {
+        /* revive a dead symbol */
+        index->dead--;
+        if (index->fuzzy && sym->fuzzy_idx >= 0) {
+          fuzzy_restore(index->fuzzy, sym->fuzzy_idx);
+        } else if (index->fuzzy) {
+          add_fuzzy(index, sym);
+        }
+      }
+      return sym;
+    }
+  }
+
+  Symbol *sym = check_alloc(malloc(sizeof(*sym) + len + 1));
+  memcpy(sym->text, s, len);
+  sym->text[len] = '\0';
+  sym->len = len;
+  sym->hash = h;
+  sym->refs = 1;
+  sym->fuzzy_idx = -1;
+  sym->next = *bucket;
+  *bucket = sym;
+  if (index->fuzzy) { add_fuzzy(index, sym); }
+
+  if (index->recent_count == RECENT_MAX) { merge_recent(index); }
+  int i = lower_bound(index->recent, index->recent_count, s, len);
+  memmove(index->recent + i + 1, index->recent + i,
+    (index->recent_count - i) * sizeof(*index->recent));
+  index->recent[i] = sym;
+  index->recent_count++;
+  if (++index->total == index->capacity) { grow(index); }
+  return sym;
+}
+
+
+static void release_symbol(SymbolIndex *index, Symbol *sym) {
+  if (--sym->refs > 0) { return; }
+  if (index->fuzzy && sym->fuzzy_idx >= 0) {
+    fuzzy_remove(index->fuzzy, sym->fuzzy_idx);
+  }
+  index->dead++;
+  if (index->dead >= RECENT_MAX && index->dead * 2 > index->total) {
+    purge(index);
+  }
+}
+
+
+SymbolIndex* symbols_new(const char *pattern) {
+  SymbolIndex *index = check_alloc(calloc(1, sizeof(*index)));
+  index->pattern = check_alloc(strdup(pattern));
+  index->refs = 1;
+  grow(index);
+  return index;
+}
+
+
+void symbols_release(SymbolIndex *index) {
+  if (--index->refs > 0) { return; }
+  for (int i = 0; i < index->count; i++) { free(index->sorted[i]); }
+  for (int i = 0; i < index->recent_count; i++) { free(index->recent[i]); }
+  free_fuzzy(index);
+  free(index->fuzzy_syms);
+  free(index->pattern);
+  free(index->buckets);
+  free(index->sorted);
+  free(index->res);
+  free(index);
+}
+
+
+int symbols_count(SymbolIndex *index) {
+  return index->total - index->dead;
+}
+
+
+/* returns up to `max` symbols starting with `prefix`, in sorted order; the
+** result is valid until the index next changes */
+const char** symbols_prefix(SymbolIndex *index, const char *prefix, size_t len,
+  int max, int *count)
+{
+  int n = 0;
+  int i = lower_bound(index->sorted, index->count, prefix, len);
+  int j = lower_bound(index->recent, index->recent_count, prefix, len);
+  while (n != max) {
+    /* take the lesser of the next sorted and recent symbols */
+    Symbol *a = i < index->count ? index->sorted[i] : NULL;
+    Symbol *b = j < index->recent_count ? index->recent[j] : NULL;
+    Symbol *sym;
+    if (a && (!b || compare(a->text, a->len, b->text, b->len) < 0)) {
+      sym = a;
+      i++;
+    } else if (b) {
+      sym = b;
+      j++;
+    } else {
+      break;
+    }
+    if (sym->len < len || memcmp(sym->text, prefix, len) != 0) { break; }
+    if (sym->refs > 0) { index->res[n++] = sym->text; }
+  }
+  *count = n;
+  return index->res;
+}
+
+
+/* returns the best `max` fuzzy matches for `needle`, best first; the result
+** is valid until the index next changes */
+const char** symbols_match(SymbolIndex *index, const char *needle, int max,
+  int *count)
+{
+  *count = 0;
+  if (symbols_count(index) == 0) { return index->res; }
+
+  if (!index->fuzzy) {
+    merge_recent(index);
+    int n = 0;
+    const char **strs = check_alloc(malloc(index->count * sizeof(*strs)));
+    size_t *lens = check_alloc(malloc(index->count * sizeof(*lens)));
+    index->fuzzy_capacity = index->capacity;
+    index->fuzzy_syms = check_alloc(realloc(index->fuzzy_syms,
+      index->fuzzy_capacity * sizeof(*index->fuzzy_syms)));
+    for (int i = 0; i < index->count; i++) {
+      Symbol *sym = index->sorted[i];
+      sym->fuzzy_idx = -1;
+      if (sym->refs == 0) { continue; }
+      strs[n] = sym->text;
+      lens[n] = sym->len;
+      index->fuzzy_syms[n] = sym;
+      sym->fuzzy_idx = n++;
+    }
+    index->fuzzy = fuzzy_new(strs, lens, n);
+    free(strs);
+    free(lens);
+    if (!index->fuzzy) { return index->res; }
+  }
+
+  const int *res = fuzzy_match(index->fuzzy, needle, max, count);
+  for (int i = 0; i < *count; i++) {
+    index->res[i] = index->fuzzy_syms[res[i]]->text;
+  }
+  return index->res;
+}
+
+
+SymbolDoc* symbols_new_doc(SymbolIndex *index) {
+  SymbolDoc *doc = check_alloc(calloc(1, sizeof(*doc)));
+  doc->index = index;
+  index->refs++;
+  return doc;
+}
+
+
+static void release_line(SymbolIndex *index, SymbolLine *line) {
+  for (int i = 0; i < line->count; i++) {
+    release_symbol(index, line->syms[i]);
+  }
+  free(line->syms);
+}
+
+
+void symbols_free_doc(SymbolDoc *doc) {
+  for (int i = 0; i < doc->count; i++) {
+    release_line(doc->index, &doc->lines[i]);
+  }
+  symbols_release(doc->index);
+  free(doc->lines);
+  free(doc);
+}
+
+
+int symbols_line_count(SymbolDoc *doc) {
+  return doc->count;
+}
+
+
+static SymbolLine find_symbols(SymbolIndex *index, const char *s, size_t len) {
+  SymbolLine line = { NULL, 0 };
+  int capacity = 0;
+  size_t init = 0, start, end;
+  while (init <= len && pattern_match(s, len, init, index->pattern, &start, &end)) {
+    /* like `gmatch()`, empty matches are skipped over */
+    if (end == start) {
+      init = end + 1;
+      continue;
+    }
+    if (line.count == capacity) {
+      capacity = capacity ? capacity * 2 : 4;
+      line.syms = check_alloc(realloc(line.syms, capacity * sizeof(Symbol*)));
+    }
+    line.syms[line.count++] = retain_symbol(index, s + start, end - start);
+    init = end;
+  }
+  return line;
+}
+
+
+/* replaces `remove` lines starting at the 0-based `line` with the `insert`
+** lines of `texts` */
+void symbols_splice(SymbolDoc *doc, int line, int remove, const char **texts,
+  const size_t *lens, int insert)
+{
+  /* the new lines' symbols are retained before the old lines' are released,
+  ** so symbols on both are never removed and added back */
+  SymbolLine *lines = check_alloc(malloc(insert * sizeof(*lines) + 1));
+  for (int i = 0; i < insert; i++) {
+    lines[i] = find_symbols(doc->index, texts[i], lens[i]);
+  }
+  for (int i = line; i < line + remove; i++) {
+    release_line(doc->index, &doc->lines[i]);
+  }
+
+  int count = doc->count - remove + insert;
+  if (count > doc->capacity) {
+    doc->capacity = count * 2;
+    doc->lines = check_alloc(realloc(doc->lines,
+      doc->capacity * sizeof(*doc->lines)));
+  }
+  memmove(doc->lines + line + insert, doc->lines + line + remove,
+    (doc->count - line - remove) * sizeof(*doc->lines));
+  memcpy(doc->lines + line, lines, insert * sizeof(*lines));
+  doc->count = count;
+  free(lines);
+}
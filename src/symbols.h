@@ -0,0 +1,20 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stddef.h>
+
+typedef struct SymbolIndex SymbolIndex;
+typedef struct SymbolDoc SymbolDoc;
+
+SymbolIndex* symbols_new(const char *pattern);
+void symbols_release(SymbolIndex *index);
+int symbols_count(SymbolIndex *index);
+const char** symbols_prefix(SymbolIndex *index, const char *prefix, size_t len, int max, int *count);
+const char** symbols_match(SymbolIndex *index, const char *needle, int max, int *count);
+
+SymbolDoc* symbols_new_doc(SymbolIndex *index);
+void symbols_free_doc(SymbolDoc *doc);
+int symbols_line_count(SymbolDoc *doc);
+void symbols_splice(SymbolDoc *doc, int line, int remove, const char **texts, const size_t *lens, int insert);
+
+#endif
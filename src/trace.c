@@ -0,0 +1,99 @@
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <string.h>
+#include "trace.h"
+
+/* records spans of activity on the main thread for export as Chrome trace
+** events -- `trace_begin()` opens a span and `trace_end()` closes the latest
+** open one, which is then stored as a complete event in a ring buffer holding
+** the last MAX_EVENTS spans. `trace_end_to()` closes every span opened above
+** the given depth, so spans left open by an error are closed along with their
+** parent. Spans still open when the trace is written are written up to the
+** current time and marked as unfinished, showing what was running at the
+** time. This is only meant to be used from the main thread */
+
+#define MAX_EVENTS 16384
+#define MAX_DEPTH 64
+#define NAME_SIZE 48
+
+typedef struct {
+  const char *cat;
+  char name[NAME_SIZE];
+  double start, dur;
+} Event;
+
+static Event events[MAX_EVENTS];
+static int event_count, next_event;
+static Event stack[MAX_DEPTH];
+static int depth;
+
+
+static double get_time(void) {
+  return SDL_GetPerformanceCounter() * 1e6 / SDL_GetPerformanceFrequency();
+}
+
+
+/* returns the depth of the new span, to be passed to `trace_end_to()` */
+int trace_begin(const char *cat, const char *name) {
+  if (depth < MAX_DEPTH) {
+    Event *e = &stack[depth];
+    e->cat = cat;
+    strncpy(e->name, name, NAME_SIZE - 1);
+    e->name[NAME_SIZE - 1] = '\0';
+    e->start = get_time();
+  }
+  return depth++;
+}
+
+
+void trace_end(void) {
+  if (depth == 0) { return; }
+  if (--depth >= MAX_DEPTH) { return; }
+  Event *e = &events[next_event];
+  *e = stack[depth];
+  e->dur = get_time() - e->start;
+  next_event = (next_event + 1) % MAX_EVENTS;
+  if (event_count < MAX_EVENTS) { event_count++; }
+}
+
+
+void trace_end_to(int d) {
+  while (depth > d) { trace_end(); }
+}
+
+
+static void write_event(FILE *fp, const Event *e, double dur, bool first,
+  bool unfinished)
+{
+  fprintf(fp, "%s{\"cat\":\"%s\",\"name\":\"", first ? "" : ",\n", e->cat);
+  for (const unsigned char *p = (const unsigned char*) e->name; *p; p++) {
+    if (*p < 0x20 || *p == '"' || *p == '\\') {
+      fprintf(fp, "\\u%04x", *p);
+    } else {
+      fputc(*p, fp);
+    }
+  }
+  fprintf(fp, "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f",
+    e->start, dur);
+  fprintf(fp, "%s}", unfinished ? ",\"args\":{\"unfinished\":true}" : "");
+}
+
+
+/* writes the recorded spans, oldest first, followed by the open spans */
+int trace_write(FILE *fp) {
+  bool first = true;
+  fprintf(fp, "{\"traceEvents\":[\n");
+  int start = (next_event - event_count + MAX_EVENTS) % MAX_EVENTS;
+  for (int i = 0; i < event_count; i++) {
+    const Event *e = &events[(start + i) % MAX_EVENTS];
+    write_event(fp, e, e->dur, first, false);
+    first = false;
+  }
+  double now = get_time();
+  for (int i = 0; i < depth && i < MAX_DEPTH; i++) {
+    write_event(fp, &stack[i], now - stack[i].start, first, true);
+    first = false;
+  }
+  fprintf(fp, "\n]}\n");
+  return ferror(fp) ? -1 : 0;
+}
@@ -0,0 +1,11 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+int trace_begin(const char *cat, const char *name);
+void trace_end(void);
+void trace_end_to(int depth);
+int trace_write(FILE *fp);
+
+#endif